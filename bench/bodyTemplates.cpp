@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "../common/jsonWriter.hpp"
+#include "../shipments/quoteBodies.hpp"
+
+// Confronto tra la costruzione dei corpi di preventivo con il DOM di
+// nlohmann::json (com'era nei worker), con JsonWriter e con i template
+// constexpr di quoteBodies.hpp. Prima dei tempi verifica che i tre metodi
+// producano gli stessi byte su input casuali.
+//
+// Uso: bodyTemplates [iterazioni per vettore, default 1000000]
+
+struct QuoteInput {
+    std::string accessKey;
+    std::string userId;
+    std::string password;
+    std::string originCountry;
+    std::string destinationCountry;
+    double weight, length, width, height;
+};
+
+std::vector<QuoteInput> makeInputs(size_t count) {
+    static const char* countries[] = {"IT", "DE", "FR", "US", "GB", "ES", "NL", "JP"};
+    std::mt19937_64 random(12345);
+    std::uniform_real_distribution<double> weight(0.1, 70);
+    std::uniform_real_distribution<double> size(1, 150);
+    std::vector<QuoteInput> inputs;
+    for (size_t i = 0; i < count; i++) {
+        inputs.push_back({"AK" + std::to_string(random() % 100000), "user\"" + std::to_string(i), "p\\ss\n",
+                          countries[random() % 8], countries[random() % 8],
+                          weight(random), size(random), size(random), static_cast<double>(random() % 100)});
+    }
+    return inputs;
+}
+
+std::string domDhl(const QuoteInput& in) {
+    nlohmann::json requestBody = {
+        {"weight", in.weight},
+        {"dimensions", {{"length", in.length}, {"width", in.width}, {"height", in.height}}},
+        {"origin", {{"country", in.originCountry}}},
+        {"destination", {{"country", in.destinationCountry}}}
+    };
+    return requestBody.dump();
+}
+
+std::string domFedEx(const QuoteInput& in) {
+    nlohmann::json requestBody = {
+        {"version", {{"serviceId", "rate"}, {"major", 1}, {"minor", 0}}},
+        {"requestedShipment", {
+            {"shipper", {{"address", {{"countryCode", in.originCountry}}}}},
+            {"recipient", {{"address", {{"countryCode", in.destinationCountry}}}}},
+            {"packageCount", 1},
+            {"requestedPackageLineItems", {{
+                {"weight", {{"value", in.weight}}},
+                {"dimensions", {{"length", in.length}, {"width", in.width}, {"height", in.height}}}
+            }}}
+        }}
+    };
+    return requestBody.dump();
+}
+
+std::string domUps(const QuoteInput& in) {
+    nlohmann::json requestBody = {
+        {"AccessRequest", {
+            {"AccessLicenseNumber", in.accessKey},
+            {"UserId", in.userId},
+            {"Password", in.password}
+        }},
+        {"RateRequest", {
+            {"Shipment", {
+                {"Shipper", {{"Address", {{"CountryCode", in.originCountry}}}}},
+                {"ShipTo", {{"Address", {{"CountryCode", in.destinationCountry}}}}},
+                {"Package", {{
+                    {"PackagingType", {{"Code", "02"}}},
+                    {"Dimensions", {{"Length", in.length}, {"Width", in.width}, {"Height", in.height}}},
+                    {"PackageWeight", {{"UnitOfMeasurement", {{"Code", "LBS"}}}, {"Weight", in.weight}}}
+                }}}
+            }}
+        }}
+    };
+    return requestBody.dump();
+}
+
+void writerDhl(std::string& out, const QuoteInput& in) {
+    JsonWriter json(out);
+    json.beginObject()
+        .key("destination").beginObject().field("country", in.destinationCountry).endObject()
+        .key("dimensions").beginObject()
+            .field("height", in.height).field("length", in.length).field("width", in.width)
+        .endObject()
+        .key("origin").beginObject().field("country", in.originCountry).endObject()
+        .field("weight", in.weight)
+        .endObject();
+}
+
+void templateDhl(std::string& out, const QuoteInput& in) {
+    writeDhlQuoteBody(out, in.originCountry, in.destinationCountry, in.weight, in.length, in.width, in.height);
+}
+
+void templateFedEx(std::string& out, const QuoteInput& in) {
+    writeFedExQuoteBody(out, in.originCountry, in.destinationCountry, in.weight, in.length, in.width, in.height);
+}
+
+void templateUps(std::string& out, const QuoteInput& in) {
+    writeUpsQuoteBody(out, in.accessKey, in.userId, in.password, in.originCountry, in.destinationCountry,
+                      in.weight, in.length, in.width, in.height);
+}
+
+// Tempo medio per corpo in nanosecondi; il buffer è riusato come nei worker
+template <typename Render>
+double measure(const std::vector<QuoteInput>& inputs, size_t iterations, Render render) {
+    std::string out;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        out.clear();
+        render(out, inputs[i % inputs.size()]);
+        checksum += out.size();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    if (checksum == 0) {
+        std::cerr << "Nessun byte prodotto" << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+}
+
+bool verify(const char* carrier, const std::vector<QuoteInput>& inputs,
+            std::string (*dom)(const QuoteInput&), void (*rendered)(std::string&, const QuoteInput&)) {
+    std::string out;
+    for (const auto& input : inputs) {
+        out.clear();
+        rendered(out, input);
+        std::string expected = dom(input);
+        if (out != expected) {
+            std::cerr << carrier << ": output diverso dal DOM\n  atteso:  " << expected << "\n  ottenuto: " << out << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void printRow(const char* name, double nanos, double baseline) {
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(10) << nanos << " ns" << std::setw(9) << baseline / nanos << "x\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::vector<QuoteInput> inputs = makeInputs(4096);
+
+    bool identical = verify("DHL", inputs, domDhl, templateDhl) &&
+                     verify("FedEx", inputs, domFedEx, templateFedEx) &&
+                     verify("UPS", inputs, domUps, templateUps);
+    if (!identical) {
+        return 1;
+    }
+    std::cout << "Output identico al DOM su " << inputs.size() << " input per vettore\n\n";
+
+    auto dom = [](std::string (*build)(const QuoteInput&)) {
+        return [build](std::string& out, const QuoteInput& in) { out = build(in); };
+    };
+
+    double baseline = measure(inputs, iterations, dom(domDhl));
+    std::cout << "DHL\n";
+    printRow("  DOM nlohmann::json", baseline, baseline);
+    printRow("  JsonWriter", measure(inputs, iterations, writerDhl), baseline);
+    printRow("  template", measure(inputs, iterations, templateDhl), baseline);
+
+    baseline = measure(inputs, iterations, dom(domFedEx));
+    std::cout << "FedEx\n";
+    printRow("  DOM nlohmann::json", baseline, baseline);
+    printRow("  template", measure(inputs, iterations, templateFedEx), baseline);
+
+    baseline = measure(inputs, iterations, dom(domUps));
+    std::cout << "UPS\n";
+    printRow("  DOM nlohmann::json", baseline, baseline);
+    printRow("  template", measure(inputs, iterations, templateUps), baseline);
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include <boost/asio.hpp>
+
+// Benchmark dell'avvio a freddo in modalità azione OpenWhisk: avvia più volte
+// un binario con OW_ACTION=1 e misura, come farebbe l'invoker, il tempo
+// dall'avvio del processo alla prima risposta a /run (attesa della porta,
+// /init e prima attivazione), poi la latenza delle attivazioni a caldo sullo
+// stesso processo.
+//
+// Uso: coldStart --binary <percorso> [--params <file JSON o JSON>] [--runs N]
+//                [--warm N] [--port P]
+
+struct ColdStartOptions {
+    std::string binary;
+    std::string params = "{}";
+    int runs = 10;
+    int warm = 20;
+    unsigned short port = 18181;
+};
+
+ColdStartOptions parseOptions(int argc, char* argv[]) {
+    ColdStartOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--binary") options.binary = value;
+        else if (name == "--params") options.params = value;
+        else if (name == "--runs") options.runs = std::max(1, std::stoi(value));
+        else if (name == "--warm") options.warm = std::max(0, std::stoi(value));
+        else if (name == "--port") options.port = static_cast<unsigned short>(std::stoul(value));
+        else throw std::runtime_error("Opzione sconosciuta: " + name);
+    }
+    if (options.binary.empty()) {
+        throw std::runtime_error("Manca --binary");
+    }
+    // I parametri possono essere un file
+    if (!options.params.empty() && options.params[0] != '{') {
+        std::ifstream file(options.params);
+        if (!file) {
+            throw std::runtime_error("File dei parametri non trovato: " + options.params);
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        options.params = content.str();
+    }
+    options.params = nlohmann::json::parse(options.params).dump();
+    return options;
+}
+
+using Clock = std::chrono::steady_clock;
+
+double millisSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// POST sincrono sulla connessione aperta; restituisce lo status HTTP
+int post(boost::asio::ip::tcp::socket& socket, const std::string& path, const std::string& body, std::string& response) {
+    std::string request = "POST " + path + " HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n"
+                          "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    boost::asio::streambuf buffer;
+    size_t headerSize = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+    std::string headers(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + headerSize);
+    buffer.consume(headerSize);
+    size_t contentLength = 0;
+    size_t pos = headers.find("Content-Length:");
+    if (pos != std::string::npos) {
+        contentLength = std::strtoul(headers.c_str() + pos + 15, nullptr, 10);
+    }
+    if (buffer.size() < contentLength) {
+        boost::asio::read(socket, buffer, boost::asio::transfer_exactly(contentLength - buffer.size()));
+    }
+    response.assign(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_begin(buffer.data()) + contentLength);
+    return std::atoi(headers.c_str() + headers.find(' ') + 1);
+}
+
+struct ColdStartSample {
+    double ready = 0;       // porta in ascolto
+    double init = 0;        // risposta a /init
+    double firstRun = 0;    // risposta alla prima /run: l'avvio a freddo
+    std::vector<double> warmRuns;
+};
+
+ColdStartSample measure(const ColdStartOptions& options) {
+    ColdStartSample sample;
+    auto start = Clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork non riuscita");
+    }
+    if (pid == 0) {
+        setenv("OW_ACTION", "1", 1);
+        setenv("OW_ACTION_PORT", std::to_string(options.port).c_str(), 1);
+        setenv("OW_METRICS_PORT", "0", 1);
+        // I log dell'azione non si mescolano ai risultati
+        int devNull = open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+        }
+        execl(options.binary.c_str(), options.binary.c_str(), static_cast<char*>(nullptr));
+        std::perror("exec");
+        _exit(127);
+    }
+
+    boost::asio::io_context io_context;
+    boost::asio::ip::tcp::socket socket(io_context);
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address("127.0.0.1"), options.port);
+    try {
+        // Come l'invoker: tentativi di connessione finché il proxy non è in ascolto
+        for (;;) {
+            boost::system::error_code ec;
+            socket.connect(endpoint, ec);
+            if (!ec) {
+                break;
+            }
+            socket.close();
+            int status = 0;
+            if (waitpid(pid, &status, WNOHANG) == pid) {
+                throw std::runtime_error("Il processo è terminato prima di aprire la porta");
+            }
+            if (millisSince(start) > 10000) {
+                throw std::runtime_error("Porta non aperta entro 10 s");
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        socket.set_option(boost::asio::ip::tcp::no_delay(true));
+        sample.ready = millisSince(start);
+
+        std::string response;
+        if (post(socket, "/init", R"({"value":{"name":"coldStart","main":"main","binary":true,"code":""}})", response) != 200) {
+            throw std::runtime_error("/init non riuscita: " + response);
+        }
+        sample.init = millisSince(start);
+
+        std::string run = R"({"value":)" + options.params + R"(,"activation_id":"coldstart","namespace":"bench"})";
+        int status = post(socket, "/run", run, response);
+        sample.firstRun = millisSince(start);
+        if (status != 200) {
+            std::cerr << "Prima /run: status " << status << " " << response << std::endl;
+        }
+
+        for (int i = 0; i < options.warm; i++) {
+            auto begin = Clock::now();
+            post(socket, "/run", run, response);
+            sample.warmRuns.push_back(millisSince(begin));
+        }
+    } catch (...) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        throw;
+    }
+
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+    return sample;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * (values.size() - 1) + 0.5))];
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        ColdStartOptions options = parseOptions(argc, argv);
+
+        std::vector<double> ready, init, firstRun, warm;
+        for (int i = 0; i < options.runs; i++) {
+            ColdStartSample sample = measure(options);
+            ready.push_back(sample.ready);
+            init.push_back(sample.init);
+            firstRun.push_back(sample.firstRun);
+            warm.insert(warm.end(), sample.warmRuns.begin(), sample.warmRuns.end());
+        }
+
+        std::cout << options.binary << " (" << options.runs << " avvii, " << warm.size() << " attivazioni a caldo)" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << std::left << std::setw(28) << "ms dall'avvio" << std::right
+                  << std::setw(10) << "min" << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "max" << std::endl;
+        auto row = [](const char* name, const std::vector<double>& values) {
+            std::cout << std::left << std::setw(28) << name << std::right
+                      << std::setw(10) << percentile(values, 0) << std::setw(10) << percentile(values, 0.5)
+                      << std::setw(10) << percentile(values, 0.9) << std::setw(10) << percentile(values, 1) << std::endl;
+        };
+        row("porta in ascolto", ready);
+        row("/init completata", init);
+        row("prima /run (avvio a freddo)", firstRun);
+        row("/run a caldo (durata)", warm);
+    } catch (const std::exception& e) {
+        std::cerr << "Errore: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
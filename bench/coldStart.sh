@@ -0,0 +1,41 @@
+#!/bin/sh
+# Avvio a freddo in modalità azione OpenWhisk di tutti i binari: per ognuno
+# coldStart misura il tempo dall'avvio del processo alla prima /run servita e
+# la durata delle attivazioni a caldo. I parametri sono i body del workload
+# (bench/workload.jsonl); gli upstream sono quelli del mock.
+#
+# Uso: bench/coldStart.sh <directory dei binari> [opzioni di coldStart]
+# es.:  bench/coldStart.sh build --runs 20 --warm 50
+set -eu
+
+BIN=${1:?"Uso: $0 <directory dei binari> [opzioni di coldStart]"}
+shift
+BENCH=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$BENCH")
+cd "$ROOT"
+
+export OW_CONFIG="$BENCH/config.bench.json"
+
+"$BIN/mockUpstream" "$BENCH/mock.json" > /tmp/ow-coldstart-mock.log 2>&1 &
+MOCK=$!
+trap 'kill $MOCK 2>/dev/null || true' EXIT INT TERM
+sleep 1
+
+# Body del workload con il valore indicato del discriminante (type o carrier)
+params() {
+    python3 -c "
+import json, sys
+for line in open('$BENCH/workload.jsonl'):
+    body = json.loads(line)['body']
+    if body.get('type') == sys.argv[1] or body.get('carrier') == sys.argv[1]:
+        print(json.dumps(body)); break
+" "$1"
+}
+
+# binario:valore del discriminante
+for entry in routePayments:stripe routeShipping:dhl functionPaypal:paypal functionStripe:stripe \
+             functionDhl:dhl functionFedex:fedex functionUps:ups functionBestRate:best; do
+    binary=${entry%%:*}
+    "$BIN/coldStart" --binary "$BIN/$binary" --params "$(params "${entry#*:}")" "$@"
+    echo
+done
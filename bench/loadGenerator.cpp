@@ -0,0 +1,287 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <amqpcpp.h>
+#include <amqpcpp/libboostasio.h>
+#include <nlohmann/json.hpp>
+#include <boost/asio.hpp>
+#include "../common/config.hpp"
+#include "../common/metrics.hpp"
+#include "../common/rpcClient.hpp"
+
+// Generatore di carico end-to-end: ripete un workload JSONL pubblicando sulle
+// code dei router e misura, tramite il correlation_id, la latenza fino alla
+// risposta del worker sulla coda indicata da "reply_queue".
+//
+// Ogni riga del workload: {"queue", "reply_queue", "weight", "body", "vary"}.
+// weight è la frequenza relativa della riga; vary elenca i campi numerici del
+// body da scalare a caso tra 0.5x e 1.5x (per non servire tutto dalla cache).
+// Con --direct-reply 1 le richieste partono con RpcClient: le risposte arrivano
+// con direct reply-to invece che dalla reply_queue, che dà solo il nome alle
+// latenze.
+//
+// Uso: loadGenerator [--workload file] [--messages N] [--rate msg/s, 0 = massimo]
+//                    [--concurrency richieste in volo] [--timeout secondi]
+//                    [--direct-reply 0|1]
+
+struct WorkloadEntry {
+    std::string queue;
+    std::string replyQueue;
+    nlohmann::json body;
+    std::vector<std::string> vary;
+};
+
+struct BenchOptions {
+    std::string workload = "bench/workload.jsonl";
+    uint64_t messages = 10000;
+    double rate = 0;
+    uint64_t concurrency = 1000;
+    int timeoutSec = 60;
+    bool directReply = false;
+};
+
+BenchOptions parseOptions(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string name = argv[i];
+        std::string value = argv[i + 1];
+        if (name == "--workload") options.workload = value;
+        else if (name == "--messages") options.messages = std::stoull(value);
+        else if (name == "--rate") options.rate = std::stod(value);
+        else if (name == "--concurrency") options.concurrency = std::max<uint64_t>(1, std::stoull(value));
+        else if (name == "--timeout") options.timeoutSec = std::stoi(value);
+        else if (name == "--direct-reply") options.directReply = value != "0";
+        else throw std::runtime_error("Opzione sconosciuta: " + name);
+    }
+    return options;
+}
+
+// Le righe con peso maggiore compaiono più volte nella sequenza di invio
+std::vector<WorkloadEntry> loadWorkload(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Workload non trovato: " + path);
+    }
+    std::vector<WorkloadEntry> entries;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        auto document = nlohmann::json::parse(line);
+        WorkloadEntry entry{document.at("queue"), document.at("reply_queue"), document.at("body"),
+                            document.value("vary", std::vector<std::string>())};
+        for (int i = 0; i < document.value("weight", 1); i++) {
+            entries.push_back(entry);
+        }
+    }
+    if (entries.empty()) {
+        throw std::runtime_error("Workload vuoto: " + path);
+    }
+    return entries;
+}
+
+class LoadGenerator {
+public:
+    LoadGenerator(boost::asio::io_context& io_context, AMQP::Channel& channel, BenchOptions options)
+        : io_context_(io_context), channel_(channel), options_(std::move(options)),
+          workload_(loadWorkload(options_.workload)), timer_(io_context),
+          random_(std::random_device{}()), sentAt_(options_.messages) {
+        // Il prefisso distingue le risposte di questa esecuzione da quelle rimaste in coda
+        runId_ = std::to_string(random_() % 1000000) + ":";
+    }
+
+    void start() {
+        if (options_.directReply) {
+            rpc_ = std::make_unique<RpcClient>(io_context_, channel_);
+            rpc_->start();
+        }
+        for (const auto& entry : workload_) {
+            if (latencies_.count(entry.replyQueue)) {
+                continue;
+            }
+            latencies_.emplace(entry.replyQueue, std::make_unique<LatencyHistogram>());
+            channel_.declareQueue(entry.queue);
+            if (rpc_) {
+                continue;
+            }
+            channel_.declareQueue(entry.replyQueue);
+            channel_.consume(entry.replyQueue, AMQP::noack).onReceived(
+                [this, queue = entry.replyQueue](const AMQP::Message& message, uint64_t, bool) {
+                    onReply(queue, message);
+                });
+        }
+        started_ = MetricsClock::now();
+        lastReport_ = started_;
+        tick();
+    }
+
+    void report() const {
+        double seconds = std::chrono::duration<double>(MetricsClock::now() - started_).count();
+        std::cout << "\n=== Risultati ===\n"
+                  << "inviati: " << sent_ << "  risposte: " << received_ << "  errori: " << errors_
+                  << "  perse: " << (sent_ - received_) << "\n"
+                  << "durata: " << std::fixed << std::setprecision(2) << seconds << " s"
+                  << "  throughput: " << (seconds > 0 ? received_ / seconds : 0) << " msg/s\n";
+        printLatency("totale", overall_);
+        for (const auto& [queue, histogram] : latencies_) {
+            printLatency(queue, *histogram);
+        }
+    }
+
+private:
+    void tick() {
+        auto now = MetricsClock::now();
+        if (options_.rate > 0) {
+            allowance_ += options_.rate * std::chrono::duration<double>(now - lastTick_).count();
+            allowance_ = std::min(allowance_, options_.rate);   // al massimo un secondo di arretrato
+        }
+        lastTick_ = now;
+
+        while (sent_ < options_.messages && sent_ - received_ < options_.concurrency &&
+               (options_.rate <= 0 || allowance_ >= 1)) {
+            publishNext();
+            allowance_ -= 1;
+        }
+
+        if (now - lastReport_ >= std::chrono::seconds(1)) {
+            lastReport_ = now;
+            std::cout << "inviati " << sent_ << ", risposte " << received_ << ", errori " << errors_ << std::endl;
+        }
+
+        bool done = received_ >= options_.messages;
+        bool expired = now - started_ > std::chrono::seconds(options_.timeoutSec);
+        if (done || expired) {
+            if (expired && !done) {
+                std::cerr << "Timeout: " << (sent_ - received_) << " risposte mancanti" << std::endl;
+            }
+            io_context_.stop();
+            return;
+        }
+
+        timer_.expires_after(std::chrono::milliseconds(1));
+        timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (!ec) tick();
+        });
+    }
+
+    void publishNext() {
+        const WorkloadEntry& entry = workload_[sent_ % workload_.size()];
+        std::string body;
+        if (entry.vary.empty()) {
+            body = entry.body.dump();
+        } else {
+            nlohmann::json varied = entry.body;
+            std::uniform_real_distribution<double> scale(0.5, 1.5);
+            for (const auto& field : entry.vary) {
+                if (varied.contains(field) && varied[field].is_number()) {
+                    varied[field] = varied[field].get<double>() * scale(random_);
+                }
+            }
+            body = varied.dump();
+        }
+
+        if (rpc_) {
+            uint64_t index = sent_++;
+            sentAt_[index] = MetricsClock::now();
+            rpc_->call(entry.queue, body, std::chrono::seconds(options_.timeoutSec),
+                [this, index, &queue = entry.replyQueue](RpcResponse response) {
+                    if (response.ok()) {
+                        record(queue, index, response.body);
+                    }
+                });
+            return;
+        }
+
+        std::string correlationId = runId_ + std::to_string(sent_);
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setCorrelationID(correlationId);
+        envelope.setContentType("application/json");
+        sentAt_[sent_] = MetricsClock::now();
+        channel_.publish("", entry.queue, envelope);
+        sent_++;
+    }
+
+    void onReply(const std::string& queue, const AMQP::Message& message) {
+        const std::string& correlationId = message.correlationID();
+        if (correlationId.compare(0, runId_.size(), runId_) != 0) {
+            return;
+        }
+        uint64_t index = std::strtoull(correlationId.c_str() + runId_.size(), nullptr, 10);
+        record(queue, index, std::string_view(message.body(), message.bodySize()));
+    }
+
+    void record(const std::string& queue, uint64_t index, std::string_view body) {
+        if (index >= sentAt_.size() || sentAt_[index] == MetricsClock::time_point()) {
+            return;
+        }
+
+        uint64_t micros = elapsedMicros(sentAt_[index]);
+        sentAt_[index] = MetricsClock::time_point();
+        overall_.record(micros);
+        latencies_.at(queue)->record(micros);
+        received_++;
+
+        if (body.find("\"status\":\"error\"") != std::string_view::npos || body.empty()) {
+            errors_++;
+        }
+    }
+
+    static void printLatency(const std::string& name, const LatencyHistogram& histogram) {
+        auto snapshot = histogram.snapshot();
+        std::cout << std::left << std::setw(28) << name << std::right
+                  << " n=" << std::setw(8) << snapshot.count
+                  << "  p50=" << std::setw(9) << snapshot.quantile(0.5) / 1000.0 << " ms"
+                  << "  p99=" << std::setw(9) << snapshot.quantile(0.99) / 1000.0 << " ms"
+                  << "  p999=" << std::setw(9) << snapshot.quantile(0.999) / 1000.0 << " ms\n";
+    }
+
+    boost::asio::io_context& io_context_;
+    AMQP::Channel& channel_;
+    BenchOptions options_;
+    std::vector<WorkloadEntry> workload_;
+    boost::asio::steady_timer timer_;
+    std::mt19937_64 random_;
+    std::string runId_;
+    std::unique_ptr<RpcClient> rpc_;
+    std::vector<MetricsClock::time_point> sentAt_;
+    std::map<std::string, std::unique_ptr<LatencyHistogram>> latencies_;
+    LatencyHistogram overall_;
+    uint64_t sent_ = 0;
+    uint64_t received_ = 0;
+    uint64_t errors_ = 0;
+    double allowance_ = 0;
+    MetricsClock::time_point started_;
+    MetricsClock::time_point lastTick_ = MetricsClock::now();
+    MetricsClock::time_point lastReport_;
+};
+
+int main(int argc, char* argv[]) {
+    try {
+        BenchOptions options = parseOptions(argc, argv);
+
+        boost::asio::io_context io_context;
+        AMQP::Address address(amqpAddress());
+        AMQP::LibBoostAsioHandler handler(io_context);
+        AMQP::TcpConnection connection(&handler, address);
+        AMQP::TcpChannel channel(&connection);
+
+        LoadGenerator generator(io_context, channel, options);
+        generator.start();
+        io_context.run();
+        generator.report();
+    } catch (const std::exception& e) {
+        std::cerr << "Errore nel generatore di carico: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
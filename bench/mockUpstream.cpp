@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <boost/asio.hpp>
+
+// Mock HTTP dei gateway di pagamento e dei vettori per i benchmark.
+// Ogni percorso ha una distribuzione di latenza log-normale (mediana e p99),
+// una probabilità di errore HTTP e una di chiusura della connessione senza
+// risposta. La configurazione è in bench/mock.json.
+
+struct MockRoute {
+    double mu = 0;      // log-normale: ln(mediana in ms)
+    double sigma = 0;
+    double errorRate = 0;
+    double dropRate = 0;
+    int errorStatus = 500;
+    std::string body;
+};
+
+struct MockConfig {
+    unsigned short port = 18080;
+    size_t threads = 1;
+    std::unordered_map<std::string, MockRoute> routes;
+};
+
+MockConfig loadMockConfig(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Configurazione del mock non trovata: " + path);
+    }
+    auto document = nlohmann::json::parse(file);
+
+    MockConfig config;
+    config.port = document.value("port", config.port);
+    config.threads = std::max<size_t>(1, document.value("threads", config.threads));
+    for (const auto& [path, rule] : document.at("routes").items()) {
+        MockRoute route;
+        double median = rule.value("median_ms", 50.0);
+        double p99 = std::max(median, rule.value("p99_ms", median));
+        route.mu = std::log(std::max(median, 0.001));
+        // Il p99 di una log-normale è exp(mu + 2.326 sigma)
+        route.sigma = std::log(p99 / std::max(median, 0.001)) / 2.3263;
+        route.errorRate = rule.value("error_rate", 0.0);
+        route.dropRate = rule.value("drop_rate", 0.0);
+        route.errorStatus = rule.value("error_status", 500);
+        route.body = rule.value("body", nlohmann::json::object()).dump();
+        config.routes[path] = std::move(route);
+    }
+    return config;
+}
+
+class MockSession : public std::enable_shared_from_this<MockSession> {
+public:
+    MockSession(boost::asio::ip::tcp::socket socket, const MockConfig& config)
+        : socket_(std::move(socket)), timer_(socket_.get_executor()), config_(config),
+          random_(std::random_device{}()) {}
+
+    void start() { readHeaders(); }
+
+private:
+    void readHeaders() {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(socket_, buffer_, "\r\n\r\n",
+            [this, self](const boost::system::error_code& ec, size_t headerSize) {
+                if (ec) {
+                    return;
+                }
+                std::string headers(boost::asio::buffers_begin(buffer_.data()),
+                                    boost::asio::buffers_begin(buffer_.data()) + headerSize);
+                buffer_.consume(headerSize);
+
+                size_t pathStart = headers.find(' ') + 1;
+                path_ = headers.substr(pathStart, headers.find(' ', pathStart) - pathStart);
+                size_t query = path_.find('?');
+                if (query != std::string::npos) {
+                    path_.resize(query);
+                }
+
+                size_t contentLength = 0;
+                for (const char* name : {"Content-Length:", "content-length:"}) {
+                    size_t pos = headers.find(name);
+                    if (pos != std::string::npos) {
+                        contentLength = std::stoul(headers.substr(pos + std::strlen(name)));
+                    }
+                }
+                readBody(contentLength);
+            });
+    }
+
+    void readBody(size_t contentLength) {
+        if (buffer_.size() >= contentLength) {
+            buffer_.consume(contentLength);
+            respond();
+            return;
+        }
+        auto self = shared_from_this();
+        boost::asio::async_read(socket_, buffer_, boost::asio::transfer_at_least(contentLength - buffer_.size()),
+            [this, self, contentLength](const boost::system::error_code& ec, size_t) {
+                if (ec) {
+                    return;
+                }
+                readBody(contentLength);
+            });
+    }
+
+    void respond() {
+        auto it = config_.routes.find(path_);
+        if (it == config_.routes.end()) {
+            write(404, R"({"error":"not found"})", std::chrono::microseconds(0));
+            return;
+        }
+        const MockRoute& route = it->second;
+
+        std::uniform_real_distribution<double> uniform(0, 1);
+        double latencyMs = std::exp(std::normal_distribution<double>(route.mu, route.sigma)(random_));
+        auto latency = std::chrono::microseconds(static_cast<int64_t>(latencyMs * 1000));
+
+        double draw = uniform(random_);
+        if (draw < route.dropRate) {
+            // Simula un upstream che non risponde: la connessione si chiude dopo la latenza
+            auto self = shared_from_this();
+            timer_.expires_after(latency);
+            timer_.async_wait([this, self](const boost::system::error_code&) {
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+            });
+            return;
+        }
+        if (draw < route.dropRate + route.errorRate) {
+            write(route.errorStatus, R"({"error":"mock failure"})", latency);
+            return;
+        }
+        write(200, route.body, latency);
+    }
+
+    void write(int status, const std::string& body, std::chrono::microseconds latency) {
+        response_ = "HTTP/1.1 " + std::to_string(status) + (status == 200 ? " OK" : " Error") + "\r\n"
+                    "Content-Type: application/json\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                    "Connection: keep-alive\r\n\r\n" + body;
+
+        auto self = shared_from_this();
+        timer_.expires_after(latency);
+        timer_.async_wait([this, self](const boost::system::error_code&) {
+            boost::asio::async_write(socket_, boost::asio::buffer(response_),
+                [this, self](const boost::system::error_code& ec, size_t) {
+                    if (!ec) {
+                        readHeaders();
+                    }
+                });
+        });
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    const MockConfig& config_;
+    std::minstd_rand random_;
+    boost::asio::streambuf buffer_;
+    std::string path_;
+    std::string response_;
+};
+
+void accept(boost::asio::ip::tcp::acceptor& acceptor, const MockConfig& config) {
+    acceptor.async_accept([&acceptor, &config](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+        if (!ec) {
+            socket.set_option(boost::asio::ip::tcp::no_delay(true));
+            std::make_shared<MockSession>(std::move(socket), config)->start();
+        }
+        accept(acceptor, config);
+    });
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        MockConfig config = loadMockConfig(argc > 1 ? argv[1] : "bench/mock.json");
+
+        boost::asio::io_context io_context;
+        boost::asio::ip::tcp::acceptor acceptor(io_context, {boost::asio::ip::tcp::v4(), config.port});
+        acceptor.listen(boost::asio::socket_base::max_listen_connections);
+        accept(acceptor, config);
+
+        std::cout << "Mock upstream in ascolto sulla porta " << config.port << std::endl;
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < config.threads; i++) {
+            threads.emplace_back([&io_context] { io_context.run(); });
+        }
+        io_context.run();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Errore nel mock upstream: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+#include "metrics.hpp"
+
+// Modalità azione OpenWhisk: invece di consumare una coda AMQP il processo
+// implementa il protocollo dell'action proxy (POST /init e POST /run su HTTP
+// locale, porta 8080) e resta attivo tra un'attivazione e l'altra. Tutto lo
+// stato costruito all'avvio (configurazione, pool di connessioni HTTP, token
+// OAuth, cache dei preventivi, circuit breaker) serve anche le attivazioni
+// successive del container "caldo"; /init non costruisce nulla.
+//
+// Si attiva con OW_ACTION=1 (OW_ACTION_PORT cambia la porta), per esempio
+// come CMD dell'immagine Docker dell'azione.
+
+// Istante di caricamento del processo, per il tempo di avvio a freddo
+inline const MetricsClock::time_point kProcessStart = MetricsClock::now();
+
+// Marcatore che chiude i log di ogni attivazione su stdout e stderr
+inline const char* const kActivationEnd = "XXX_THE_END_OF_A_WHISK_ACTIVATION_XXX";
+
+inline bool actionMode() {
+    const char* env = std::getenv("OW_ACTION");
+    return env && *env && std::strcmp(env, "0") != 0;
+}
+
+inline unsigned short actionPort() {
+    const char* env = std::getenv("OW_ACTION_PORT");
+    return env ? static_cast<unsigned short>(std::strtoul(env, nullptr, 10)) : 8080;
+}
+
+// Un'attivazione: i parametri (il campo "value" di /run, già serializzato), la
+// scadenza indicata da OpenWhisk, in millisecondi dall'epoch (0 = nessuna), e
+// il resto del contesto (activation_id, action_name, namespace, ...). Il
+// contesto non va nelle variabili __OW_* dell'ambiente, che il processo
+// condivide tra le attivazioni concorrenti
+struct ActionRun {
+    std::string params;
+    int64_t deadline = 0;
+    std::string activationId;
+    std::map<std::string, std::string> context;
+};
+
+// Server dell'action proxy sull'io_context del chiamante. onRun riceve i
+// parametri e una callback per il risultato (un oggetto JSON), da chiamare
+// una sola volta, anche più tardi; più attivazioni possono essere in corso
+// insieme (concorrenza nel container).
+class ActionServer {
+public:
+    using Respond = std::function<void(std::string result)>;
+    using RunHandler = std::function<void(ActionRun run, Respond respond)>;
+
+    ActionServer(boost::asio::io_context& io_context, RunHandler onRun)
+        : acceptor_(io_context), onRun_(std::move(onRun)),
+          runs_(metrics().counter("ow_action_runs_total", "Attivazioni servite in modalità azione")),
+          runLatency_(metrics().histogram("ow_action_run_seconds", "Durata delle attivazioni, da /run alla risposta")) {
+        probes_.push_back(metrics().probe("ow_action_cold_start_seconds", "Dall'avvio del processo alla prima risposta a /run",
+            "gauge", "", [this] { return coldStartSeconds_.load(std::memory_order_relaxed); }));
+    }
+
+    void start(unsigned short port = actionPort()) {
+        boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), port);
+        acceptor_.open(endpoint.protocol());
+        acceptor_.set_option(boost::asio::socket_base::reuse_address(true));
+        acceptor_.bind(endpoint);
+        acceptor_.listen(boost::asio::socket_base::max_listen_connections);
+        accept();
+        std::cout << "Action proxy in ascolto sulla porta " << port << std::endl;
+    }
+
+private:
+    class Session : public std::enable_shared_from_this<Session> {
+    public:
+        Session(boost::asio::ip::tcp::socket socket, ActionServer& server) : socket_(std::move(socket)), server_(server) {}
+
+        void start() { readHeaders(); }
+
+        // Risposta alla richiesta corrente; la connessione resta aperta per la successiva
+        void write(int status, std::string body) {
+            const char* reason = status == 200 ? " OK" : status == 404 ? " Not Found" : " Error";
+            response_ = "HTTP/1.1 " + std::to_string(status) + reason + "\r\n"
+                        "Content-Type: application/json\r\n"
+                        "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+            auto self = shared_from_this();
+            boost::asio::async_write(socket_, boost::asio::buffer(response_),
+                [this, self](const boost::system::error_code& ec, size_t) {
+                    if (!ec) {
+                        readHeaders();
+                    }
+                });
+        }
+
+        boost::asio::any_io_executor executor() { return socket_.get_executor(); }
+
+    private:
+        void readHeaders() {
+            auto self = shared_from_this();
+            boost::asio::async_read_until(socket_, buffer_, "\r\n\r\n",
+                [this, self](const boost::system::error_code& ec, size_t headerSize) {
+                    if (ec) {
+                        return;
+                    }
+                    std::string headers(boost::asio::buffers_begin(buffer_.data()),
+                                        boost::asio::buffers_begin(buffer_.data()) + headerSize);
+                    buffer_.consume(headerSize);
+
+                    size_t pathStart = headers.find(' ') + 1;
+                    path_ = headers.substr(pathStart, headers.find(' ', pathStart) - pathStart);
+                    size_t contentLength = 0;
+                    for (const char* name : {"Content-Length:", "content-length:"}) {
+                        size_t pos = headers.find(name);
+                        if (pos != std::string::npos) {
+                            contentLength = std::strtoul(headers.c_str() + pos + std::strlen(name), nullptr, 10);
+                        }
+                    }
+                    readBody(contentLength);
+                });
+        }
+
+        void readBody(size_t contentLength) {
+            if (buffer_.size() >= contentLength) {
+                std::string body(boost::asio::buffers_begin(buffer_.data()),
+                                 boost::asio::buffers_begin(buffer_.data()) + contentLength);
+                buffer_.consume(contentLength);
+                server_.dispatch(shared_from_this(), path_, body);
+                return;
+            }
+            auto self = shared_from_this();
+            boost::asio::async_read(socket_, buffer_, boost::asio::transfer_at_least(contentLength - buffer_.size()),
+                [this, self, contentLength](const boost::system::error_code& ec, size_t) {
+                    if (!ec) {
+                        readBody(contentLength);
+                    }
+                });
+        }
+
+        boost::asio::ip::tcp::socket socket_;
+        ActionServer& server_;
+        boost::asio::streambuf buffer_;
+        std::string path_;
+        std::string response_;
+    };
+
+    void accept() {
+        acceptor_.async_accept([this](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+            if (!ec) {
+                socket.set_option(boost::asio::ip::tcp::no_delay(true));
+                std::make_shared<Session>(std::move(socket), *this)->start();
+            }
+            accept();
+        });
+    }
+
+    static std::string errorBody(const std::string& message) {
+        return nlohmann::json{{"error", message}}.dump();
+    }
+
+    // Variabili d'ambiente dell'azione, ricevute una volta sola da /init
+    static void exportVariable(const std::string& name, const nlohmann::json& value) {
+        std::string text = value.is_string() ? value.get<std::string>() : value.dump();
+#ifdef _WIN32
+        _putenv_s(name.c_str(), text.c_str());
+#else
+        setenv(name.c_str(), text.c_str(), 1);
+#endif
+    }
+
+    void dispatch(const std::shared_ptr<Session>& session, const std::string& path, const std::string& body) {
+        if (path == "/init") {
+            init(*session, body);
+        } else if (path == "/run") {
+            run(session, body);
+        } else {
+            session->write(404, errorBody("Percorso sconosciuto: " + path));
+        }
+    }
+
+    // Il codice dell'azione è già nel binario: /init riceve solo le variabili
+    // d'ambiente dell'azione
+    void init(Session& session, const std::string& body) {
+        if (initialized_) {
+            session.write(403, errorBody("L'azione è già inizializzata"));
+            return;
+        }
+        auto document = nlohmann::json::parse(body, nullptr, false);
+        if (document.is_discarded() || !document.is_object()) {
+            session.write(400, errorBody("Richiesta /init non valida"));
+            return;
+        }
+        // items() non prolunga la vita del temporaneo: le variabili vanno in un oggetto con nome
+        auto env = document.value("value", nlohmann::json::object()).value("env", nlohmann::json::object());
+        for (const auto& [name, variable] : env.items()) {
+            exportVariable(name, variable);
+        }
+        initialized_ = true;
+        session.write(200, R"({"ok":true})");
+    }
+
+    void run(const std::shared_ptr<Session>& session, const std::string& body) {
+        auto received = MetricsClock::now();
+        if (!initialized_) {
+            session->write(403, errorBody("Azione non inizializzata"));
+            return;
+        }
+        auto document = nlohmann::json::parse(body, nullptr, false);
+        if (document.is_discarded() || !document.is_object()) {
+            session->write(400, errorBody("Richiesta /run non valida"));
+            return;
+        }
+
+        ActionRun run;
+        for (const auto& [name, field] : document.items()) {
+            if (name != "value") {
+                run.context[name] = field.is_string() ? field.get<std::string>() : field.dump();
+            }
+        }
+        auto activationId = run.context.find("activation_id");
+        if (activationId != run.context.end()) {
+            run.activationId = activationId->second;
+        }
+        if (document.contains("deadline")) {
+            const auto& deadline = document["deadline"];
+            run.deadline = deadline.is_number() ? deadline.get<int64_t>()
+                : deadline.is_string() ? std::strtoll(deadline.get<std::string>().c_str(), nullptr, 10) : 0;
+        }
+        run.params = document.value("value", nlohmann::json::object()).dump();
+
+        onRun_(std::move(run), [this, session, received](std::string result) {
+            boost::asio::dispatch(session->executor(), [this, session, received, result = std::move(result)]() mutable {
+                finish(*session, received, std::move(result));
+            });
+        });
+    }
+
+    void finish(Session& session, MetricsClock::time_point received, std::string result) {
+        // Il risultato di un'azione deve essere un oggetto JSON
+        size_t first = result.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos || result[first] != '{') {
+            session.write(502, errorBody("L'azione non ha restituito un oggetto JSON"));
+        } else {
+            session.write(200, std::move(result));
+        }
+        runs_.add();
+        runLatency_.recordSince(received);
+        if (!served_) {
+            served_ = true;
+            double seconds = std::chrono::duration<double>(MetricsClock::now() - kProcessStart).count();
+            coldStartSeconds_.store(seconds, std::memory_order_relaxed);
+            std::cout << "Prima attivazione servita dopo " << seconds * 1000 << " ms dall'avvio" << std::endl;
+        }
+        std::cout << kActivationEnd << std::endl;
+        std::cerr << kActivationEnd << std::endl;
+    }
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+    RunHandler onRun_;
+    bool initialized_ = false;
+    bool served_ = false;
+    Counter& runs_;
+    LatencyHistogram& runLatency_;
+    std::atomic<double> coldStartSeconds_{0};
+    std::vector<ProbeHandle> probes_;
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include "jsonWriter.hpp"
+
+// Template dei corpi JSON a forma fissa: una sequenza constexpr di frammenti
+// letterali e di segnaposto tipizzati che indicano quale argomento inserire.
+// Il rendering è un'unica passata espansa a compile time: i frammenti sono
+// copiati così come sono, i numeri formattati sul posto e solo le stringhe
+// passano dall'escape JSON. Il tipo di ogni segnaposto è verificato in
+// compilazione contro l'argomento corrispondente.
+namespace bodytpl {
+
+struct Text {
+    std::string_view value;
+};
+
+template <size_t I> struct StringHole {};    // stringa JSON, con escape
+template <size_t I> struct NumberHole {};    // double, formattato come nlohmann::json
+template <size_t I> struct IntegerHole {};   // intero
+
+constexpr Text text(std::string_view value) { return Text{value}; }
+template <size_t I> constexpr StringHole<I> string() { return {}; }
+template <size_t I> constexpr NumberHole<I> number() { return {}; }
+template <size_t I> constexpr IntegerHole<I> integer() { return {}; }
+
+template <typename... Parts>
+class BodyTemplate {
+public:
+    constexpr explicit BodyTemplate(Parts... parts) : parts_(parts...) {}
+
+    // Byte fissi del corpo, noti in compilazione
+    constexpr size_t literalSize() const {
+        return std::apply([](const Parts&... parts) { return (size_t{0} + ... + sizeOf(parts)); }, parts_);
+    }
+
+    // Scrive il corpo in coda a out; args sono i valori dei segnaposto, per indice
+    template <typename... Args>
+    void render(std::string& out, const Args&... args) const {
+        auto values = std::forward_as_tuple(args...);
+        out.reserve(out.size() + literalSize() + 24 * sizeof...(Args));
+        std::apply([&](const Parts&... parts) { (append(out, parts, values), ...); }, parts_);
+    }
+
+private:
+    static constexpr size_t sizeOf(const Text& part) { return part.value.size(); }
+    template <typename Hole>
+    static constexpr size_t sizeOf(const Hole&) { return 0; }
+
+    template <typename Values>
+    static void append(std::string& out, const Text& part, const Values&) {
+        out.append(part.value.data(), part.value.size());
+    }
+
+    template <size_t I, typename Values>
+    static void append(std::string& out, StringHole<I>, const Values& values) {
+        using Arg = std::decay_t<std::tuple_element_t<I, Values>>;
+        static_assert(std::is_convertible_v<const Arg&, std::string_view>, "Il segnaposto richiede una stringa");
+        jsonfmt::appendString(out, std::get<I>(values));
+    }
+
+    template <size_t I, typename Values>
+    static void append(std::string& out, NumberHole<I>, const Values& values) {
+        using Arg = std::decay_t<std::tuple_element_t<I, Values>>;
+        static_assert(std::is_floating_point_v<Arg>, "Il segnaposto richiede un double");
+        jsonfmt::appendNumber(out, static_cast<double>(std::get<I>(values)));
+    }
+
+    template <size_t I, typename Values>
+    static void append(std::string& out, IntegerHole<I>, const Values& values) {
+        using Arg = std::decay_t<std::tuple_element_t<I, Values>>;
+        static_assert(std::is_integral_v<Arg>, "Il segnaposto richiede un intero");
+        jsonfmt::appendNumber(out, static_cast<int64_t>(std::get<I>(values)));
+    }
+
+    std::tuple<Parts...> parts_;
+};
+
+template <typename... Parts>
+constexpr BodyTemplate<Parts...> bodyTemplate(Parts... parts) {
+    return BodyTemplate<Parts...>(parts...);
+}
+
+}  // namespace bodytpl
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <amqpcpp.h>
+
+// Scadenza di una richiesta: l'istante oltre il quale chi l'ha inviata non
+// aspetta più la risposta, in millisecondi dall'epoch (orologio di sistema,
+// perché passa tra processi e host diversi); 0 = nessuna scadenza.
+// Un messaggio scaduto riceve subito una risposta di errore, senza chiamare
+// l'upstream, e tra quelli in attesa passano prima quelli che scadono prima.
+
+// Header con la scadenza assoluta, scritto dal chiamante o dal router
+inline const std::string kDeadlineHeader = "x-deadline-ms";
+// Campo del body con la scadenza assoluta, letto dai worker (deadline_ms,
+// nel confronto tariffe, è invece la durata della raccolta dei preventivi)
+inline const std::string kDeadlineField = "expires_at_ms";
+
+inline int64_t epochMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Scadenza dalle proprietà AMQP, in ordine:
+//  1. header x-deadline-ms (intero o stringa)
+//  2. timestamp di pubblicazione (secondi) + expiration (TTL in millisecondi)
+inline int64_t messageDeadline(const AMQP::MetaData& message) {
+    if (message.hasHeaders() && message.headers().contains(kDeadlineHeader)) {
+        const AMQP::Field& header = message.headers().get(kDeadlineHeader);
+        if (header.isInteger()) {
+            return static_cast<int64_t>(header);
+        }
+        if (header.isString()) {
+            return std::strtoll(static_cast<const std::string&>(header).c_str(), nullptr, 10);
+        }
+    }
+    if (message.hasExpiration() && message.hasTimestamp()) {
+        int64_t ttl = std::strtoll(message.expiration().c_str(), nullptr, 10);
+        if (ttl > 0) {
+            return static_cast<int64_t>(message.timestamp()) * 1000 + ttl;
+        }
+    }
+    return 0;
+}
+
+// Con più scadenze vale la più vicina
+inline int64_t earliestDeadline(int64_t a, int64_t b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    return a < b ? a : b;
+}
+
+inline bool deadlineExpired(int64_t deadline, int64_t now = epochMillis()) {
+    return deadline != 0 && now >= deadline;
+}
+
+// Scadenza sul messaggio inoltrato, come header: niente expiration, perché
+// il broker scarterebbe il messaggio scaduto senza che il chiamante riceva
+// la risposta di errore
+inline void setMessageDeadline(AMQP::MetaData& envelope, int64_t deadline) {
+    AMQP::Table headers = envelope.headers();
+    headers.set(kDeadlineHeader, static_cast<int64_t>(deadline));
+    envelope.setHeaders(headers);
+}
+
+// Risposta a un messaggio già scaduto: una publish, nessuna chiamata upstream
+inline const std::string& expiredReply() {
+    static const std::string reply = R"({"status":"error","message":"Richiesta scaduta prima dell'elaborazione"})";
+    return reply;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "config.hpp"
+
+// Numero di event loop del processo e pinning sui core, dalla sezione
+// "runtime" della configurazione; OW_THREADS sovrascrive il numero di thread.
+// threads = 0 significa un event loop per core.
+struct RuntimeSettings {
+    size_t threads = 1;
+    bool pinCores = false;
+};
+
+inline RuntimeSettings runtimeSettings() {
+    RuntimeSettings settings;
+    const auto& runtime = config().value("runtime", nlohmann::json::object());
+    settings.threads = runtime.value("threads", settings.threads);
+    settings.pinCores = runtime.value("pin_cores", settings.pinCores);
+
+    if (const char* env = std::getenv("OW_THREADS")) {
+        settings.threads = std::strtoul(env, nullptr, 10);
+    }
+    if (settings.threads == 0) {
+        settings.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return settings;
+}
+
+// Vincola il thread corrente a un core (ignorato sulle piattaforme non supportate)
+inline void pinCurrentThread(size_t index) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t cpu = index % cores;
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        std::cerr << "Impossibile vincolare il thread " << index << " al core " << cpu << std::endl;
+    }
+#else
+    (void)cpu;
+#endif
+}
+
+// Esegue loop(index) su N thread, incluso quello chiamante. Ogni loop crea il
+// proprio io_context, la propria connessione e il proprio canale AMQP: i
+// thread non condividono oggetti AMQP né handle libcurl.
+inline void runEventLoops(const std::function<void(size_t index)>& loop) {
+    RuntimeSettings settings = runtimeSettings();
+
+    std::vector<std::thread> threads;
+    for (size_t index = 1; index < settings.threads; index++) {
+        threads.emplace_back([&loop, &settings, index] {
+            if (settings.pinCores) {
+                pinCurrentThread(index);
+            }
+            loop(index);
+        });
+    }
+
+    if (settings.pinCores) {
+        pinCurrentThread(0);
+    }
+    loop(0);
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
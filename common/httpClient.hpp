@@ -0,0 +1,825 @@
+#pragma once
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <curl/curl.h>
+#include <boost/asio.hpp>
+#include "metrics.hpp"
+#include "responseSummary.hpp"
+#include "upstreamPolicy.hpp"
+
+// Richiesta HTTP: POST se body non è vuoto, altrimenti GET
+struct HttpRequest {
+    std::string url;
+    std::vector<std::string> headers;
+    std::string body;
+    std::string userPwd;
+    std::string upstream;   // nome dell'upstream nelle metriche (es. "dhl"); vuoto = nessuna metrica
+    bool idempotent = false;  // ripetibile senza effetti: può essere duplicata (hedging)
+    // Con uno schema, una risposta 2xx viene letta mentre arriva e il corpo
+    // consegnato è il risultato compatto; quello originale solo con includeRaw
+    const ResponseSchema* schema = nullptr;
+    bool includeRaw = false;
+
+    // Aggiunge l'intestazione line + value riusando le stringhe di una richiesta
+    // riciclata (le intestazioni vuote vengono ignorate da perform)
+    void addHeader(std::string_view line, std::string_view value = {}) {
+        for (auto& header : headers) {
+            if (header.empty()) {
+                header.append(line).append(value);
+                return;
+            }
+        }
+        headers.emplace_back(line).append(value);
+    }
+};
+
+// Risposta HTTP consegnata al completamento del trasferimento
+struct HttpResponse {
+    CURLcode curlCode = CURLE_OK;
+    long status = 0;
+    std::string body;
+    std::string error;
+
+    bool ok() const { return curlCode == CURLE_OK; }
+};
+
+using HttpCallback = std::function<void(HttpResponse)>;
+
+// Parametri del pool di connessioni verso gli host upstream
+struct HttpClientOptions {
+    long maxConnectionsPerHost = 32;   // connessioni parallele per host (HTTP/1.1)
+    long maxCachedConnections = 128;   // connessioni inattive mantenute aperte
+    long dnsCacheTimeoutSec = 300;
+    long keepAliveIdleSec = 30;
+    bool http2 = true;                 // multiplexing HTTP/2 dove supportato
+    size_t pooledRequests = 1024;      // richieste e trasferimenti conservati per il riuso
+    long connectTimeoutMs = 2000;      // timeout delle richieste senza upstream;
+    long timeoutMs = 15000;            // per gli upstream valgono upstream_policies
+};
+
+// Contatori di riuso delle connessioni, leggibili anche da altri thread
+struct HttpConnectionStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> connectionsOpened{0};
+    std::atomic<uint64_t> handshakesAvoided{0};  // richieste servite su una connessione già aperta
+    std::atomic<uint64_t> cancelled{0};          // trasferimenti interrotti con cancel()
+};
+
+// Cache DNS e sessioni TLS condivise da tutti i client del processo,
+// così anche una nuova connessione può riprendere una sessione TLS esistente
+inline CURLSH* sharedCurlCache() {
+    static std::mutex locks[CURL_LOCK_DATA_LAST];
+    static CURLSH* share = [] {
+        CURLSH* handle = curl_share_init();
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(handle, CURLSHOPT_LOCKFUNC, +[](CURL*, curl_lock_data data, curl_lock_access, void*) {
+            locks[data].lock();
+        });
+        curl_share_setopt(handle, CURLSHOPT_UNLOCKFUNC, +[](CURL*, curl_lock_data data, void*) {
+            locks[data].unlock();
+        });
+        return handle;
+    }();
+    return share;
+}
+
+// Client HTTP asincrono: integra l'interfaccia multi-socket di libcurl
+// con l'io_context di Boost.Asio, così le richieste verso gateway e vettori
+// non bloccano il thread che serve anche la connessione AMQP.
+// Le connessioni restano aperte (keep-alive) nella cache del multi handle e
+// vengono riusate per host; gli easy handle sono riciclati tra le richieste.
+// Anche richieste e trasferimenti sono riciclati: le stringhe di URL, corpo e
+// intestazioni conservano la loro capacità e la lista delle intestazioni per
+// libcurl viene ricostruita solo se cambia, così a regime una richiesta non alloca.
+// Ogni richiesta ha un timeout, adattato alle latenze osservate dell'upstream;
+// le richieste idempotenti lente possono essere duplicate (hedging) entro un budget.
+// Non è thread-safe: va usato solo dal thread che esegue io_context.run().
+class AsyncHttpClient {
+public:
+    explicit AsyncHttpClient(boost::asio::io_context& io_context, HttpClientOptions options = {})
+        : io_context_(io_context), timer_(io_context), options_(options) {
+        static std::once_flag curlInit;
+        std::call_once(curlInit, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+        multi_ = curl_multi_init();
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &AsyncHttpClient::socketCallback);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &AsyncHttpClient::timerCallback);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+        curl_multi_setopt(multi_, CURLMOPT_PIPELINING, options_.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        curl_multi_setopt(multi_, CURLMOPT_MAX_HOST_CONNECTIONS, options_.maxConnectionsPerHost);
+        curl_multi_setopt(multi_, CURLMOPT_MAXCONNECTS, options_.maxCachedConnections);
+
+        auto& registry = metrics();
+        probes_.push_back(registry.probe("ow_http_connections_opened_total", "Connessioni HTTP aperte verso gli upstream", "counter", "",
+            [this] { return static_cast<double>(stats_.connectionsOpened.load()); }));
+        probes_.push_back(registry.probe("ow_http_handshakes_avoided_total", "Richieste HTTP servite su una connessione già aperta", "counter", "",
+            [this] { return static_cast<double>(stats_.handshakesAvoided.load()); }));
+        probes_.push_back(registry.probe("ow_http_cancelled_total", "Trasferimenti HTTP interrotti prima della risposta", "counter", "",
+            [this] { return static_cast<double>(stats_.cancelled.load()); }));
+        upstreamBytes_ = &registry.counter("ow_response_summary_bytes_total",
+            "Byte delle risposte riassunte: ricevuti dall'upstream e consegnati al worker", "body=\"upstream\"");
+        summaryBytes_ = &registry.counter("ow_response_summary_bytes_total",
+            "Byte delle risposte riassunte: ricevuti dall'upstream e consegnati al worker", "body=\"summary\"");
+        probes_.push_back(registry.probe("ow_http_in_flight", "Trasferimenti HTTP in corso", "gauge", "",
+            [this] { return static_cast<double>(inFlightCount_.load(std::memory_order_relaxed)); }));
+    }
+
+    ~AsyncHttpClient() {
+        timer_.cancel();
+        for (auto& transfer : transfers_) {
+            curl_multi_remove_handle(multi_, transfer->curl);
+            curl_easy_cleanup(transfer->curl);
+        }
+        transfers_.clear();
+        idleTransfers_.clear();
+        for (CURL* curl : idleHandles_) {
+            curl_easy_cleanup(curl);
+        }
+        idleHandles_.clear();
+        curl_multi_cleanup(multi_);
+        sockets_.clear();
+    }
+
+    AsyncHttpClient(const AsyncHttpClient&) = delete;
+    AsyncHttpClient& operator=(const AsyncHttpClient&) = delete;
+
+    // Richiesta vuota, presa dal pool se disponibile: va riempita e passata a perform
+    HttpRequest newRequest() {
+        if (idleRequests_.empty()) {
+            return HttpRequest();
+        }
+        HttpRequest request = std::move(idleRequests_.back());
+        idleRequests_.pop_back();
+        return request;
+    }
+
+    // Restituisce al pool una richiesta non inviata (es. preventivo servito dalla cache)
+    void recycle(HttpRequest&& request) {
+        if (idleRequests_.size() >= options_.pooledRequests) {
+            return;
+        }
+        request.url.clear();
+        request.body.clear();
+        request.userPwd.clear();
+        request.upstream.clear();
+        request.idempotent = false;
+        request.schema = nullptr;
+        request.includeRaw = false;
+        for (auto& header : request.headers) {
+            header.clear();
+        }
+        idleRequests_.push_back(std::move(request));
+    }
+
+    // Avvia la richiesta e ritorna subito; il callback viene invocato
+    // sull'io_context al termine del trasferimento (anche in caso di errore).
+    // Se la richiesta è idempotente e l'upstream ha l'hedging attivo, dopo il
+    // ritardo adattivo parte una seconda copia e vince la prima risposta.
+    // Restituisce l'identificativo da passare a cancel (0 se non è partita)
+    uint64_t perform(HttpRequest request, HttpCallback callback) {
+        UpstreamState* upstream = upstreamState(request.upstream);
+        long hedgeDelayMs = 0;
+        if (upstream && request.idempotent && upstream->latency->policy().hedge) {
+            // Il budget cresce con le richieste: le copie restano una frazione del traffico
+            upstream->hedgeTokens = std::min(upstream->hedgeTokens + upstream->latency->policy().hedgeBudget, kMaxHedgeTokens);
+            hedgeDelayMs = upstream->latency->hedgeDelayMs();
+        }
+        if (hedgeDelayMs == 0) {
+            return startTransfer(std::move(request), std::move(callback), upstream);
+        }
+
+        auto hedge = std::make_shared<Hedge>(io_context_);
+        hedge->callback = std::move(callback);
+        hedge->upstream = upstream;
+        hedge->transfers[0] = startTransfer(std::move(request), [this, hedge](HttpResponse response) {
+            onHedgedResponse(hedge, 0, std::move(response));
+        }, upstream);
+        if (hedge->transfers[0] == 0) {
+            return 0;
+        }
+        hedge->id = hedge->transfers[0];
+        hedges_[hedge->id] = hedge;
+
+        hedge->timer.expires_after(std::chrono::milliseconds(hedgeDelayMs));
+        hedge->timer.async_wait([this, hedge](const boost::system::error_code& ec) {
+            if (!ec && !hedge->done) {
+                sendHedge(hedge);
+            }
+        });
+        return hedge->id;
+    }
+
+    // Interrompe un trasferimento in corso senza invocarne il callback.
+    // Restituisce false se è già terminato (o il callback è già stato chiamato)
+    bool cancel(uint64_t id) {
+        // Una richiesta duplicata si annulla insieme alla sua copia
+        auto it = hedges_.find(id);
+        if (it != hedges_.end()) {
+            std::shared_ptr<Hedge> hedge = it->second;
+            finishHedge(hedge);
+            return true;
+        }
+        return cancelTransfer(id);
+    }
+
+    // Numero di trasferimenti ancora in corso
+    size_t inFlight() const { return transfers_.size(); }
+
+    const HttpConnectionStats& stats() const { return stats_; }
+
+private:
+    struct Transfer {
+        HttpRequest request;
+        HttpResponse response;
+        HttpCallback callback;
+        CURL* curl = nullptr;
+        uint64_t id = 0;
+        size_t slot = 0;                        // posizione in transfers_
+        curl_slist* headers = nullptr;
+        std::vector<std::string> headerLines;   // intestazioni da cui è stata costruita la lista
+        char errorBuffer[CURL_ERROR_SIZE] = {0};
+        ResponseSummarizer summarizer;          // estrazione dei campi della risposta
+        bool bodyStarted = false;
+        bool summarizing = false;               // risposta 2xx con schema
+        size_t bodyBytes = 0;
+
+        Transfer() = default;
+        Transfer(const Transfer&) = delete;
+        Transfer& operator=(const Transfer&) = delete;
+        ~Transfer() { curl_slist_free_all(headers); }
+
+        // Le richieste verso lo stesso upstream hanno quasi sempre le stesse
+        // intestazioni: la lista di libcurl si ricostruisce solo se cambiano
+        void updateHeaders() {
+            size_t count = 0;
+            bool same = true;
+            for (const auto& header : request.headers) {
+                if (header.empty()) {
+                    continue;
+                }
+                same = same && count < headerLines.size() && headerLines[count] == header;
+                count++;
+            }
+            if (same && count == headerLines.size()) {
+                return;
+            }
+
+            curl_slist_free_all(headers);
+            headers = nullptr;
+            headerLines.clear();
+            for (const auto& header : request.headers) {
+                if (!header.empty()) {
+                    headerLines.push_back(header);
+                    headers = curl_slist_append(headers, header.c_str());
+                }
+            }
+        }
+    };
+
+    // Stato per upstream di questo client: metriche, timeout adattivo e budget di hedging
+    struct UpstreamState {
+        UpstreamMetrics* metrics = nullptr;
+        AdaptiveLatency* latency = nullptr;
+        double hedgeTokens = 0;       // copie ancora consentite dal budget
+        size_t hedgesInFlight = 0;
+        Counter* hedgesSent = nullptr;
+        Counter* hedgesWon = nullptr;      // la copia ha risposto per prima
+        Counter* hedgesSkipped = nullptr;  // copia non inviata per budget o limite
+    };
+
+    // Richiesta duplicata: la prima risposta riuscita vince e l'altra viene annullata
+    struct Hedge {
+        explicit Hedge(boost::asio::io_context& io_context) : timer(io_context) {}
+        boost::asio::steady_timer timer;
+        HttpCallback callback;
+        UpstreamState* upstream = nullptr;
+        uint64_t id = 0;                 // identificativo restituito da perform
+        uint64_t transfers[2] = {0, 0};  // originale e copia; 0 = terminato o non partito
+        bool hedged = false;
+        bool done = false;
+    };
+
+    // Oltre questa soglia il budget non si accumula: dopo un periodo tranquillo
+    // non può partire una raffica di copie
+    static constexpr double kMaxHedgeTokens = 10;
+
+    UpstreamState* upstreamState(const std::string& name) {
+        if (name.empty()) {
+            return nullptr;
+        }
+        auto it = upstreams_.find(name);
+        if (it == upstreams_.end()) {
+            UpstreamState state;
+            state.metrics = &upstreamMetrics(name);
+            state.latency = &adaptiveLatency(name);
+            auto counter = [&name](const char* result) {
+                return &metrics().counter("ow_http_hedges_total", "Copie delle richieste idempotenti lente (hedging) per esito",
+                                          "upstream=\"" + name + "\",result=\"" + result + "\"");
+            };
+            state.hedgesSent = counter("sent");
+            state.hedgesWon = counter("won");
+            state.hedgesSkipped = counter("skipped");
+            it = upstreams_.emplace(name, state).first;
+        }
+        return &it->second;
+    }
+
+    // Allo scadere del ritardo parte la copia, se il budget e il limite lo consentono
+    void sendHedge(const std::shared_ptr<Hedge>& hedge) {
+        UpstreamState& upstream = *hedge->upstream;
+        Transfer* primary = findTransfer(hedge->transfers[0]);
+        if (!primary) {
+            return;
+        }
+        if (upstream.hedgeTokens < 1 || upstream.hedgesInFlight >= upstream.latency->policy().maxHedgesInFlight) {
+            upstream.hedgesSkipped->add();
+            return;
+        }
+
+        HttpRequest copy = newRequest();
+        copy.url = primary->request.url;
+        copy.headers = primary->request.headers;
+        copy.body = primary->request.body;
+        copy.userPwd = primary->request.userPwd;
+        copy.upstream = primary->request.upstream;
+        copy.idempotent = true;
+        copy.schema = primary->request.schema;
+        copy.includeRaw = primary->request.includeRaw;
+
+        hedge->transfers[1] = startTransfer(std::move(copy), [this, hedge](HttpResponse response) {
+            onHedgedResponse(hedge, 1, std::move(response));
+        }, &upstream);
+        if (hedge->transfers[1] != 0) {
+            upstream.hedgeTokens -= 1;
+            upstream.hedgesInFlight++;
+            upstream.hedgesSent->add();
+            hedge->hedged = true;
+        }
+    }
+
+    void onHedgedResponse(const std::shared_ptr<Hedge>& hedge, size_t index, HttpResponse response) {
+        if (hedge->done) {
+            return;
+        }
+        hedge->transfers[index] = 0;
+        // Un errore di rete non conclude la richiesta se l'altra copia è ancora in corso
+        if (!response.ok() && hedge->transfers[1 - index] != 0) {
+            return;
+        }
+        if (index == 1 && response.ok()) {
+            hedge->upstream->hedgesWon->add();
+        }
+        HttpCallback callback = std::move(hedge->callback);
+        finishHedge(hedge);
+        callback(std::move(response));
+    }
+
+    // Chiude il gruppo: ferma il timer e annulla la copia ancora in corso
+    void finishHedge(const std::shared_ptr<Hedge>& hedge) {
+        hedge->done = true;
+        hedge->timer.cancel();
+        for (uint64_t& id : hedge->transfers) {
+            if (id != 0) {
+                cancelTransfer(id);
+                id = 0;
+            }
+        }
+        if (hedge->hedged) {
+            hedge->upstream->hedgesInFlight--;
+        }
+        hedges_.erase(hedge->id);
+    }
+
+    Transfer* findTransfer(uint64_t id) {
+        auto it = std::find_if(transfers_.begin(), transfers_.end(),
+                               [id](const std::unique_ptr<Transfer>& transfer) { return transfer->id == id; });
+        return id == 0 || it == transfers_.end() ? nullptr : it->get();
+    }
+
+    bool cancelTransfer(uint64_t id) {
+        Transfer* found = findTransfer(id);
+        if (!found) {
+            return false;
+        }
+        CURL* curl = found->curl;
+        std::unique_ptr<Transfer> transfer = takeTransfer(curl);
+        curl_multi_remove_handle(multi_, curl);
+        releaseHandle(curl);
+        releaseTransfer(std::move(transfer));
+        inFlightCount_.store(transfers_.size(), std::memory_order_relaxed);
+        stats_.cancelled++;
+        return true;
+    }
+
+    struct SocketState {
+        explicit SocketState(boost::asio::io_context& io_context) : socket(io_context) {}
+        boost::asio::ip::tcp::socket socket;
+        int mask = 0;
+        bool readPending = false;
+        bool writePending = false;
+    };
+
+    // Callback per gestire la risposta HTTP: con uno schema i pezzi di una
+    // risposta 2xx passano al parser e il corpo si conserva solo se richiesto
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* transfer = static_cast<Transfer*>(userp);
+        const char* data = static_cast<const char*>(contents);
+        size_t length = size * nmemb;
+        if (transfer->request.schema && !transfer->bodyStarted) {
+            // Le intestazioni sono già arrivate: lo status è quello definitivo
+            long status = 0;
+            curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &status);
+            transfer->summarizing = status >= 200 && status < 300;
+            if (transfer->summarizing) {
+                transfer->summarizer.start(*transfer->request.schema);
+            }
+        }
+        transfer->bodyStarted = true;
+        if (transfer->summarizing) {
+            transfer->bodyBytes += length;
+            transfer->summarizer.feed(data, length);
+            if (!transfer->request.includeRaw) {
+                return length;
+            }
+        }
+        transfer->response.body.append(data, length);
+        return length;
+    }
+
+    // Configura e avvia un trasferimento con il timeout dell'upstream
+    uint64_t startTransfer(HttpRequest request, HttpCallback callback, UpstreamState* upstream) {
+        CURL* curl = acquireHandle();
+        if (!curl) {
+            HttpResponse response;
+            response.curlCode = CURLE_FAILED_INIT;
+            response.error = curl_easy_strerror(CURLE_FAILED_INIT);
+            boost::asio::post(io_context_, [callback = std::move(callback), response = std::move(response)]() mutable {
+                callback(std::move(response));
+            });
+            return 0;
+        }
+
+        std::unique_ptr<Transfer> transfer = acquireTransfer();
+        transfer->id = ++lastTransferId_;
+        transfer->request = std::move(request);
+        transfer->callback = std::move(callback);
+        transfer->updateHeaders();
+
+        curl_easy_setopt(curl, CURLOPT_URL, transfer->request.url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+        if (!transfer->request.body.empty()) {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->request.body.c_str());
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(transfer->request.body.size()));
+        }
+        if (!transfer->request.userPwd.empty()) {
+            curl_easy_setopt(curl, CURLOPT_USERPWD, transfer->request.userPwd.c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &AsyncHttpClient::WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, transfer->errorBuffer);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+
+        // Una connessione bloccata non deve trattenere il worker all'infinito
+        long connectTimeoutMs = options_.connectTimeoutMs;
+        long timeoutMs = options_.timeoutMs;
+        if (upstream) {
+            connectTimeoutMs = upstream->latency->policy().connectTimeoutMs;
+            timeoutMs = upstream->latency->timeoutMs();
+        }
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, connectTimeoutMs);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+
+        // Riuso delle connessioni: keep-alive TCP, HTTP/2 multiplexato se il server
+        // lo negozia via ALPN, cache DNS e sessioni TLS condivise
+        curl_easy_setopt(curl, CURLOPT_SHARE, sharedCurlCache());
+        curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, options_.dnsCacheTimeoutSec);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, options_.keepAliveIdleSec);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, options_.keepAliveIdleSec);
+        if (options_.http2) {
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+        }
+
+        // I socket vengono aperti da Asio, così possono essere osservati dall'io_context
+        curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION, &AsyncHttpClient::openSocket);
+        curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, this);
+        curl_easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION, &AsyncHttpClient::closeSocket);
+        curl_easy_setopt(curl, CURLOPT_CLOSESOCKETDATA, this);
+
+        transfer->curl = curl;
+        transfer->slot = transfers_.size();
+        transfers_.push_back(std::move(transfer));
+        inFlightCount_.store(transfers_.size(), std::memory_order_relaxed);
+        curl_multi_add_handle(multi_, curl);
+        return transfers_.back()->id;
+    }
+
+    std::unique_ptr<Transfer> acquireTransfer() {
+        if (idleTransfers_.empty()) {
+            return std::make_unique<Transfer>();
+        }
+        std::unique_ptr<Transfer> transfer = std::move(idleTransfers_.back());
+        idleTransfers_.pop_back();
+        return transfer;
+    }
+
+    // Dopo il callback: la richiesta torna nel pool, il trasferimento conserva
+    // la lista delle intestazioni per la prossima richiesta
+    void releaseTransfer(std::unique_ptr<Transfer> transfer) {
+        recycle(std::move(transfer->request));
+        transfer->request = HttpRequest();
+        transfer->response = HttpResponse();
+        transfer->callback = nullptr;
+        transfer->errorBuffer[0] = '\0';
+        transfer->bodyStarted = false;
+        transfer->summarizing = false;
+        transfer->bodyBytes = 0;
+        if (idleTransfers_.size() < options_.pooledRequests) {
+            idleTransfers_.push_back(std::move(transfer));
+        }
+    }
+
+    CURL* acquireHandle() {
+        if (idleHandles_.empty()) {
+            return curl_easy_init();
+        }
+        CURL* curl = idleHandles_.back();
+        idleHandles_.pop_back();
+        return curl;
+    }
+
+    // L'handle torna nel pool: curl_easy_reset azzera le opzioni ma conserva
+    // le cache interne; le connessioni aperte restano nella cache del multi
+    void releaseHandle(CURL* curl) {
+        curl_easy_reset(curl);
+        if (idleHandles_.size() < static_cast<size_t>(options_.maxCachedConnections)) {
+            idleHandles_.push_back(curl);
+        } else {
+            curl_easy_cleanup(curl);
+        }
+    }
+
+    static curl_socket_t openSocket(void* clientp, curlsocktype purpose, struct curl_sockaddr* address) {
+        auto* self = static_cast<AsyncHttpClient*>(clientp);
+        if (purpose != CURLSOCKTYPE_IPCXN || (address->family != AF_INET && address->family != AF_INET6)) {
+            return CURL_SOCKET_BAD;
+        }
+
+        auto state = std::make_shared<SocketState>(self->io_context_);
+        boost::system::error_code ec;
+        state->socket.open(address->family == AF_INET ? boost::asio::ip::tcp::v4() : boost::asio::ip::tcp::v6(), ec);
+        if (ec) {
+            std::cerr << "Errore nell'apertura del socket HTTP: " << ec.message() << std::endl;
+            return CURL_SOCKET_BAD;
+        }
+
+        curl_socket_t fd = state->socket.native_handle();
+        self->sockets_[fd] = std::move(state);
+        return fd;
+    }
+
+    static int closeSocket(void* clientp, curl_socket_t fd) {
+        auto* self = static_cast<AsyncHttpClient*>(clientp);
+        auto it = self->sockets_.find(fd);
+        if (it != self->sockets_.end()) {
+            boost::system::error_code ec;
+            it->second->mask = 0;
+            it->second->socket.close(ec);
+            self->sockets_.erase(it);
+        }
+        return 0;
+    }
+
+    static int socketCallback(CURL*, curl_socket_t fd, int what, void* userp, void*) {
+        auto* self = static_cast<AsyncHttpClient*>(userp);
+        auto it = self->sockets_.find(fd);
+        if (it == self->sockets_.end()) {
+            return 0;
+        }
+
+        it->second->mask = (what == CURL_POLL_REMOVE) ? 0 : what;
+        self->arm(fd, it->second);
+        return 0;
+    }
+
+    static int timerCallback(CURLM*, long timeoutMs, void* userp) {
+        auto* self = static_cast<AsyncHttpClient*>(userp);
+        self->timer_.cancel();
+        if (timeoutMs < 0) {
+            return 0;
+        }
+
+        // Anche con timeout 0 si passa dall'io_context: libcurl non consente
+        // di richiamare curl_multi_socket_action dal callback del timer
+        self->timer_.expires_after(std::chrono::milliseconds(timeoutMs));
+        self->timer_.async_wait([self](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            int running = 0;
+            curl_multi_socket_action(self->multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+            self->checkCompleted();
+        });
+        return 0;
+    }
+
+    void arm(curl_socket_t fd, const std::shared_ptr<SocketState>& state) {
+        if (!state->socket.is_open()) {
+            return;
+        }
+        if ((state->mask & CURL_POLL_IN) && !state->readPending) {
+            state->readPending = true;
+            wait(fd, state, boost::asio::ip::tcp::socket::wait_read, CURL_CSELECT_IN);
+        }
+        if ((state->mask & CURL_POLL_OUT) && !state->writePending) {
+            state->writePending = true;
+            wait(fd, state, boost::asio::ip::tcp::socket::wait_write, CURL_CSELECT_OUT);
+        }
+    }
+
+    void wait(curl_socket_t fd, const std::shared_ptr<SocketState>& state,
+              boost::asio::ip::tcp::socket::wait_type type, int action) {
+        std::weak_ptr<SocketState> weak = state;
+        state->socket.async_wait(type, [this, fd, weak, action](const boost::system::error_code& ec) {
+            // Il socket può essere stato chiuso (e il descrittore riusato) nel frattempo
+            auto state = weak.lock();
+            if (!state) {
+                return;
+            }
+            if (action == CURL_CSELECT_IN) {
+                state->readPending = false;
+            } else {
+                state->writePending = false;
+            }
+            if (ec == boost::asio::error::operation_aborted) {
+                return;
+            }
+
+            int wanted = (action == CURL_CSELECT_IN) ? CURL_POLL_IN : CURL_POLL_OUT;
+            if (state->mask & wanted) {
+                int running = 0;
+                curl_multi_socket_action(multi_, fd, ec ? CURL_CSELECT_ERR : action, &running);
+                checkCompleted();
+            }
+
+            if (state->socket.is_open()) {
+                arm(fd, state);
+            }
+        });
+    }
+
+    // Toglie il trasferimento dall'elenco di quelli attivi spostando l'ultimo al suo posto
+    std::unique_ptr<Transfer> takeTransfer(CURL* curl) {
+        char* data = nullptr;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, &data);
+        auto* found = reinterpret_cast<Transfer*>(data);
+        if (!found || found->slot >= transfers_.size() || transfers_[found->slot].get() != found) {
+            return nullptr;
+        }
+        size_t slot = found->slot;
+        std::unique_ptr<Transfer> transfer = std::move(transfers_[slot]);
+        if (slot + 1 != transfers_.size()) {
+            transfers_[slot] = std::move(transfers_.back());
+            transfers_[slot]->slot = slot;
+        }
+        transfers_.pop_back();
+        return transfer;
+    }
+
+    void checkCompleted() {
+        // Vettore riusato tra le chiamate (vuoto se checkCompleted è rientrante)
+        std::vector<std::unique_ptr<Transfer>> completed;
+        completed.swap(completed_);
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi_, &pending)) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL* curl = msg->easy_handle;
+            std::unique_ptr<Transfer> transfer = takeTransfer(curl);
+            if (!transfer) {
+                continue;
+            }
+
+            transfer->response.curlCode = msg->data.result;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &transfer->response.status);
+            if (transfer->response.curlCode != CURLE_OK) {
+                transfer->response.error = transfer->errorBuffer[0]
+                    ? transfer->errorBuffer
+                    : curl_easy_strerror(transfer->response.curlCode);
+            }
+
+            // Nessuna nuova connessione significa handshake TCP/TLS evitati
+            long newConnections = 0;
+            curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &newConnections);
+            stats_.requests++;
+            if (newConnections > 0) {
+                stats_.connectionsOpened += static_cast<uint64_t>(newConnections);
+            } else if (transfer->response.curlCode == CURLE_OK) {
+                stats_.handshakesAvoided++;
+            }
+            recordUpstream(curl, *transfer, newConnections > 0);
+            if (transfer->summarizing && transfer->response.ok()) {
+                summarize(*transfer);
+            }
+
+            curl_multi_remove_handle(multi_, curl);
+            releaseHandle(curl);
+            completed.push_back(std::move(transfer));
+        }
+
+        inFlightCount_.store(transfers_.size(), std::memory_order_relaxed);
+
+        // I callback possono avviare nuove richieste: vengono invocati solo
+        // dopo aver svuotato la coda dei messaggi di libcurl
+        for (auto& transfer : completed) {
+            transfer->callback(std::move(transfer->response));
+            releaseTransfer(std::move(transfer));
+        }
+        completed.clear();
+        if (completed_.capacity() < completed.capacity()) {
+            completed_.swap(completed);
+        }
+    }
+
+    // Il corpo consegnato diventa il risultato compatto (con l'originale, se richiesto)
+    void summarize(Transfer& transfer) {
+        std::string summary;
+        // Un 2xx senza risultato utilizzabile non viene consegnato come 200
+        transfer.response.status = transfer.summarizer.render(summary, transfer.response.body, transfer.response.status);
+        transfer.response.body.swap(summary);
+        upstreamBytes_->add(transfer.bodyBytes);
+        summaryBytes_->add(transfer.response.body.size());
+    }
+
+    // Tempi cumulativi misurati da libcurl dall'inizio del trasferimento;
+    // DNS, connect e TLS sono registrati solo se è stata aperta una connessione
+    void recordUpstream(CURL* curl, const Transfer& transfer, bool newConnection) {
+        UpstreamState* state = upstreamState(transfer.request.upstream);
+        if (!state) {
+            return;
+        }
+        UpstreamMetrics& upstream = *state->metrics;
+
+        upstream.requests.add();
+        curl_off_t total = 0;
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+        if (!transfer.response.ok()) {
+            upstream.errors.add();
+            // Il timeout adattivo deve vedere anche le richieste che non arrivano in tempo
+            if (transfer.response.curlCode == CURLE_OPERATION_TIMEDOUT) {
+                state->latency->recordTimeout(static_cast<uint64_t>(total));
+            }
+            return;
+        }
+
+        curl_off_t dns = 0, connect = 0, tls = 0, ttfb = 0;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+
+        if (newConnection) {
+            upstream.dns.record(static_cast<uint64_t>(dns));
+            upstream.connect.record(static_cast<uint64_t>(std::max<curl_off_t>(0, connect - dns)));
+            if (tls > 0) {
+                upstream.tls.record(static_cast<uint64_t>(std::max<curl_off_t>(0, tls - connect)));
+            }
+        }
+        upstream.ttfb.record(static_cast<uint64_t>(ttfb));
+        upstream.total.record(static_cast<uint64_t>(total));
+    }
+
+    boost::asio::io_context& io_context_;
+    boost::asio::steady_timer timer_;
+    HttpClientOptions options_;
+    HttpConnectionStats stats_;
+    CURLM* multi_ = nullptr;
+    std::vector<CURL*> idleHandles_;
+    std::vector<std::unique_ptr<Transfer>> transfers_;
+    std::vector<std::unique_ptr<Transfer>> idleTransfers_;
+    std::vector<std::unique_ptr<Transfer>> completed_;
+    std::vector<HttpRequest> idleRequests_;
+    uint64_t lastTransferId_ = 0;
+    std::unordered_map<curl_socket_t, std::shared_ptr<SocketState>> sockets_;
+    std::unordered_map<std::string, UpstreamState> upstreams_;
+    std::unordered_map<uint64_t, std::shared_ptr<Hedge>> hedges_;
+    std::atomic<size_t> inFlightCount_{0};
+    std::vector<ProbeHandle> probes_;
+    Counter* upstreamBytes_ = nullptr;
+    Counter* summaryBytes_ = nullptr;
+};
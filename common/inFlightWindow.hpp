@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "metrics.hpp"
+
+// Finestra dei messaggi in elaborazione: al massimo maxInFlight task attivi,
+// gli altri attendono. Parte prima il task della corsia a priorità più alta,
+// poi quello con la scadenza più vicina (earliest deadline first), poi il più
+// vecchio; senza priorità né scadenze l'ordine è quello di arrivo.
+// Insieme al prefetch del canale fa da backpressure: i messaggi non
+// confermati bloccano nuove consegne.
+class InFlightWindow {
+public:
+    // Da chiamare una sola volta, dopo ack (o reject) del messaggio
+    using Release = std::function<void()>;
+    using Task = std::function<void(Release release)>;
+
+    // Corsia (priorità più alta prima) e scadenza in ms dall'epoch (0 = nessuna)
+    struct Schedule {
+        uint8_t priority = 0;
+        int64_t deadline = 0;
+    };
+
+    // queue dà nome alle metriche della finestra (messaggi attivi e in attesa)
+    explicit InFlightWindow(size_t maxInFlight, const std::string& queue = "") : maxInFlight_(maxInFlight) {
+        if (!queue.empty()) {
+            std::string labels = "queue=\"" + queue + "\"";
+            probes_.push_back(metrics().probe("ow_in_flight_messages", "Messaggi in elaborazione", "gauge", labels,
+                [this] { return static_cast<double>(activeCount_.load(std::memory_order_relaxed)); }));
+            probes_.push_back(metrics().probe("ow_waiting_messages", "Messaggi in attesa di un posto nella finestra", "gauge", labels,
+                [this] { return static_cast<double>(waitingCount_.load(std::memory_order_relaxed)); }));
+        }
+    }
+
+    InFlightWindow(const InFlightWindow&) = delete;
+    InFlightWindow& operator=(const InFlightWindow&) = delete;
+
+    void submit(Task task) { submit(std::move(task), Schedule()); }
+
+    void submit(Task task, Schedule schedule) {
+        int64_t deadline = schedule.deadline != 0 ? schedule.deadline : std::numeric_limits<int64_t>::max();
+        pending_.push_back({std::move(task), schedule.priority, deadline, ++lastSequence_});
+        std::push_heap(pending_.begin(), pending_.end(), Waiting::later);
+        drain();
+        publishCounts();
+    }
+
+    size_t active() const { return active_; }
+    size_t waiting() const { return pending_.size(); }
+    bool full() const { return active_ >= maxInFlight_; }
+
+private:
+    struct Waiting {
+        Task task;
+        uint8_t priority;
+        int64_t deadline;
+        uint64_t sequence;
+
+        // Ordine dello heap: in cima il task che deve partire per primo
+        static bool later(const Waiting& a, const Waiting& b) {
+            if (a.priority != b.priority) return a.priority < b.priority;
+            if (a.deadline != b.deadline) return a.deadline > b.deadline;
+            return a.sequence > b.sequence;
+        }
+    };
+
+    // Copia leggibile dall'endpoint delle metriche, che gira su un altro thread
+    void publishCounts() {
+        activeCount_.store(active_, std::memory_order_relaxed);
+        waitingCount_.store(pending_.size(), std::memory_order_relaxed);
+    }
+
+    // Un task che lancia un'eccezione restituisce il suo posto (se non l'ha già
+    // rilasciato) e non ferma la finestra: gli altri task partono comunque e la
+    // prima eccezione arriva al chiamante di submit alla fine del ciclo
+    void drain() {
+        // Un task può rilasciare il posto in modo sincrono (es. hit in cache):
+        // il ciclo evita la ricorsione
+        if (draining_) {
+            return;
+        }
+        draining_ = true;
+        std::exception_ptr failure;
+        while (active_ < maxInFlight_ && !pending_.empty()) {
+            std::pop_heap(pending_.begin(), pending_.end(), Waiting::later);
+            Task task = std::move(pending_.back().task);
+            pending_.pop_back();
+            active_++;
+
+            auto released = std::make_shared<bool>(false);
+            try {
+                task([this, released] {
+                    if (*released) {
+                        return;
+                    }
+                    *released = true;
+                    active_--;
+                    drain();
+                    publishCounts();
+                });
+            } catch (...) {
+                if (!*released) {
+                    *released = true;
+                    active_--;
+                }
+                if (!failure) {
+                    failure = std::current_exception();
+                }
+            }
+        }
+        draining_ = false;
+        if (failure) {
+            publishCounts();
+            std::rethrow_exception(failure);
+        }
+    }
+
+    size_t maxInFlight_;
+    size_t active_ = 0;
+    bool draining_ = false;
+    std::vector<Waiting> pending_;   // heap secondo Waiting::later
+    uint64_t lastSequence_ = 0;
+    std::atomic<size_t> activeCount_{0};
+    std::atomic<size_t> waitingCount_{0};
+    std::vector<ProbeHandle> probes_;
+};
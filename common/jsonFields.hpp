@@ -0,0 +1,272 @@
+#pragma once
+
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Lettura dei campi di primo livello di un oggetto JSON direttamente dal
+// buffer del messaggio, senza costruire un DOM: le stringhe sono string_view
+// nel buffer (decodificate a parte solo se contengono escape) e i numeri sono
+// convertiti con std::from_chars. I valori annidati vengono saltati senza
+// validarne il contenuto. Un'istanza riusata tra i messaggi non alloca.
+class JsonFields {
+public:
+    // Le string_view restituite restano valide finché il buffer esiste e
+    // fino alla prossima parse()
+    void parse(const char* data, size_t size) {
+        fields_.clear();
+        decodedCount_ = 0;
+        begin_ = data;
+        end_ = data + size;
+        pos_ = data;
+
+        skipSpace();
+        expect('{');
+        skipSpace();
+        if (peek() == '}') {
+            pos_++;
+        } else {
+            for (;;) {
+                skipSpace();
+                Field field;
+                field.key = readString(field.escaped);
+                skipSpace();
+                expect(':');
+                skipSpace();
+                readValue(field);
+                fields_.push_back(field);
+                skipSpace();
+                if (peek() == ',') {
+                    pos_++;
+                    continue;
+                }
+                expect('}');
+                break;
+            }
+        }
+        skipSpace();
+        if (pos_ != end_) {
+            fail();
+        }
+    }
+
+    bool has(std::string_view key) const { return find(key) != nullptr; }
+
+    std::string_view string(std::string_view key) {
+        const Field& field = require(key, Type::String);
+        return field.escaped ? decode(field.raw) : field.raw;
+    }
+
+    double number(std::string_view key) const {
+        const Field& field = require(key, Type::Number);
+        double value = 0;
+        auto result = std::from_chars(field.raw.data(), field.raw.data() + field.raw.size(), value);
+        if (result.ec != std::errc() || result.ptr != field.raw.data() + field.raw.size()) {
+            throw std::runtime_error("Campo non valido: " + std::string(key));
+        }
+        return value;
+    }
+
+    bool boolean(std::string_view key) const {
+        return require(key, Type::Boolean).raw == "true";
+    }
+
+private:
+    enum class Type { String, Number, Boolean, Other };
+
+    struct Field {
+        std::string_view key;
+        std::string_view raw;   // per le stringhe: contenuto senza virgolette
+        Type type = Type::Other;
+        bool escaped = false;
+    };
+
+    const Field* find(std::string_view key) const {
+        // Come nlohmann::json, con chiavi duplicate vale l'ultima
+        for (auto it = fields_.rbegin(); it != fields_.rend(); ++it) {
+            if (it->key == key) {
+                return &*it;
+            }
+        }
+        return nullptr;
+    }
+
+    const Field& require(std::string_view key, Type type) const {
+        const Field* field = find(key);
+        if (!field) {
+            throw std::runtime_error("Campo mancante: " + std::string(key));
+        }
+        if (field->type != type) {
+            throw std::runtime_error("Campo non valido: " + std::string(key));
+        }
+        return *field;
+    }
+
+    char peek() const { return pos_ < end_ ? *pos_ : '\0'; }
+
+    void skipSpace() {
+        while (pos_ < end_ && (*pos_ == ' ' || *pos_ == '\t' || *pos_ == '\n' || *pos_ == '\r')) {
+            pos_++;
+        }
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            fail();
+        }
+        pos_++;
+    }
+
+    [[noreturn]] void fail() const {
+        throw std::runtime_error("JSON non valido alla posizione " + std::to_string(pos_ - begin_));
+    }
+
+    std::string_view readString(bool& escaped) {
+        expect('"');
+        const char* start = pos_;
+        escaped = false;
+        while (pos_ < end_ && *pos_ != '"') {
+            if (*pos_ == '\\') {
+                escaped = true;
+                pos_++;
+            } else if (static_cast<unsigned char>(*pos_) < 0x20) {
+                fail();
+            }
+            pos_++;
+        }
+        if (pos_ >= end_) {
+            fail();
+        }
+        std::string_view value(start, static_cast<size_t>(pos_ - start));
+        pos_++;
+        return value;
+    }
+
+    void readValue(Field& field) {
+        char c = peek();
+        if (c == '"') {
+            field.type = Type::String;
+            field.raw = readString(field.escaped);
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            const char* start = pos_;
+            while (pos_ < end_ && (std::isdigit(static_cast<unsigned char>(*pos_)) || *pos_ == '-' || *pos_ == '+' ||
+                                   *pos_ == '.' || *pos_ == 'e' || *pos_ == 'E')) {
+                pos_++;
+            }
+            field.type = Type::Number;
+            field.raw = std::string_view(start, static_cast<size_t>(pos_ - start));
+        } else if (c == '{' || c == '[') {
+            skipNested();
+        } else {
+            for (std::string_view literal : {"true", "false", "null"}) {
+                if (std::string_view(pos_, static_cast<size_t>(end_ - pos_)).substr(0, literal.size()) == literal) {
+                    if (literal != "null") {
+                        field.type = Type::Boolean;
+                        field.raw = std::string_view(pos_, literal.size());
+                    }
+                    pos_ += literal.size();
+                    return;
+                }
+            }
+            fail();
+        }
+    }
+
+    // Salta oggetti e array annidati tenendo conto delle stringhe
+    void skipNested() {
+        int depth = 0;
+        do {
+            if (pos_ >= end_) {
+                fail();
+            }
+            char c = *pos_;
+            if (c == '"') {
+                bool escaped;
+                readString(escaped);
+                continue;
+            }
+            if (c == '{' || c == '[') depth++;
+            if (c == '}' || c == ']') depth--;
+            pos_++;
+        } while (depth > 0);
+    }
+
+    // Decodifica gli escape in un buffer riusato; \uXXXX diventa UTF-8
+    std::string_view decode(std::string_view raw) {
+        if (decodedCount_ == decoded_.size()) {
+            decoded_.emplace_back();
+        }
+        std::string& out = decoded_[decodedCount_++];
+        out.clear();
+        for (size_t i = 0; i < raw.size(); i++) {
+            char c = raw[i];
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            char e = raw[++i];
+            switch (e) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned code = hex4(raw, i + 1);
+                    i += 4;
+                    if (code >= 0xD800 && code <= 0xDBFF && i + 6 < raw.size() && raw.substr(i + 1, 2) == "\\u") {
+                        unsigned low = hex4(raw, i + 3);
+                        i += 6;
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default: out += e; break;
+            }
+        }
+        return out;
+    }
+
+    unsigned hex4(std::string_view raw, size_t at) const {
+        if (at + 4 > raw.size()) {
+            fail();
+        }
+        unsigned value = 0;
+        auto result = std::from_chars(raw.data() + at, raw.data() + at + 4, value, 16);
+        if (result.ptr != raw.data() + at + 4) {
+            fail();
+        }
+        return value;
+    }
+
+    static void appendUtf8(std::string& out, unsigned code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    const char* begin_ = nullptr;
+    const char* end_ = nullptr;
+    const char* pos_ = nullptr;
+    std::vector<Field> fields_;
+    std::deque<std::string> decoded_;   // riferimenti stabili tra una decode e l'altra
+    size_t decodedCount_ = 0;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Esito della ricerca di un campo nel JSON
+enum class JsonScanResult {
+    Found,
+    Missing,
+    WrongType,
+    Invalid
+};
+
+// Handler SAX che cerca un campo stringa di primo livello senza costruire
+// il DOM: la scansione si interrompe appena il valore è stato letto
+class TopLevelStringScanner : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit TopLevelStringScanner(const std::string& field) : field_(field) {}
+
+    JsonScanResult result = JsonScanResult::Missing;
+    std::string value;
+
+    bool null() override { return scalar(); }
+    bool boolean(bool) override { return scalar(); }
+    bool number_integer(number_integer_t) override { return scalar(); }
+    bool number_unsigned(number_unsigned_t) override { return scalar(); }
+    bool number_float(number_float_t, const string_t&) override { return scalar(); }
+    bool binary(binary_t&) override { return scalar(); }
+
+    bool string(string_t& val) override {
+        if (matched_) {
+            value = std::move(val);
+            result = JsonScanResult::Found;
+            return false;
+        }
+        return true;
+    }
+
+    bool start_object(std::size_t) override { return open(); }
+    bool start_array(std::size_t) override { return open(); }
+    bool end_object() override { depth_--; return true; }
+    bool end_array() override { depth_--; return true; }
+
+    bool key(string_t& val) override {
+        matched_ = (depth_ == 1 && val == field_);
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        result = JsonScanResult::Invalid;
+        return false;
+    }
+
+private:
+    bool scalar() {
+        if (matched_) {
+            result = JsonScanResult::WrongType;
+            return false;
+        }
+        return true;
+    }
+
+    bool open() {
+        if (matched_) {
+            result = JsonScanResult::WrongType;
+            return false;
+        }
+        depth_++;
+        return true;
+    }
+
+    const std::string& field_;
+    int depth_ = 0;
+    bool matched_ = false;
+};
+
+// Legge un campo stringa di primo livello direttamente dal buffer del messaggio
+inline JsonScanResult findTopLevelString(const char* data, size_t size, const std::string& field, std::string& value) {
+    TopLevelStringScanner scanner(field);
+    nlohmann::json::sax_parse(data, data + size, &scanner);
+    if (scanner.result == JsonScanResult::Found) {
+        value = std::move(scanner.value);
+    }
+    return scanner.result;
+}
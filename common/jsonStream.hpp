@@ -0,0 +1,465 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Elemento del JSON segnalato all'handler di JsonPushParser
+enum class JsonToken {
+    BeginObject,
+    EndObject,
+    BeginArray,
+    EndArray,
+    String,
+    Number,     // testo del numero, da convertire (es. std::from_chars)
+    True,
+    False,
+    Null
+};
+
+// Parser JSON incrementale a eventi: riceve il testo a pezzi, nell'ordine in
+// cui arriva dalla rete, e chiama l'handler per ogni valore senza costruire
+// il DOM né conservare il documento. L'handler viene chiamato come
+//
+//     handler(const JsonPushParser& parser, JsonToken token, std::string_view value)
+//
+// e durante la chiamata il parser indica il percorso del valore (chiavi e
+// indici degli array, vedi matches). value è il testo di stringhe (senza
+// escape) e numeri e vale solo durante la chiamata; l'UTF-8 non viene validato.
+// Pila e buffer conservano la loro capacità dopo reset(), così a regime un
+// documento non alloca.
+class JsonPushParser {
+public:
+    static constexpr size_t kMaxDepth = 128;
+
+    void reset() {
+        state_ = State::Value;
+        depth_ = 0;
+        token_.clear();
+        highSurrogate_ = 0;
+        literal_ = nullptr;
+        literalPos_ = 0;
+    }
+
+    // Analizza il pezzo successivo; false se il documento non è JSON valido
+    template <typename Handler>
+    bool feed(const char* data, size_t size, Handler& handler) {
+        const char* end = data + size;
+        for (const char* p = data; p < end && state_ != State::Error; ) {
+            p = step(p, end, handler);
+        }
+        return state_ != State::Error;
+    }
+
+    // Fine del documento: un numero di primo livello si chiude solo qui
+    template <typename Handler>
+    bool finish(Handler& handler) {
+        if (state_ == State::Number) {
+            endNumber(handler);
+        }
+        return state_ == State::Done;
+    }
+
+    bool ok() const { return state_ != State::Error; }
+
+    // Livelli aperti sopra il valore corrente (0: documento)
+    size_t depth() const { return depth_; }
+
+    // Indice del valore nell'array al livello level (0 se non è un array)
+    size_t index(size_t level) const {
+        return level < depth_ && frames_[level].array ? frames_[level].index : 0;
+    }
+
+    // Il valore corrente è in path a partire dal livello from: una chiave per
+    // livello, "[]" per un elemento qualsiasi di un array.
+    // Es. {"output", "rateReplyDetails", "[]", "serviceType"}
+    bool matches(std::initializer_list<std::string_view> path, size_t from = 0) const {
+        return from + path.size() == depth_ && startsWith(path, from);
+    }
+
+    // Come matches, ma il valore può essere anche più in profondità
+    bool startsWith(std::initializer_list<std::string_view> path, size_t from = 0) const {
+        if (from + path.size() > depth_) {
+            return false;
+        }
+        size_t level = from;
+        for (std::string_view part : path) {
+            const Frame& frame = frames_[level++];
+            if (frame.array ? part != "[]" : part != frame.key) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    enum class State {
+        Value,          // atteso un valore
+        ArrayStart,     // dopo '[': un valore o ']'
+        ObjectStart,    // dopo '{': una chiave o '}'
+        Key,            // dopo ',' in un oggetto: una chiave
+        Colon,
+        AfterValue,     // ',' o chiusura del contenitore
+        String,
+        Escape,
+        Unicode,
+        Number,
+        Literal,
+        Done,
+        Error
+    };
+
+    struct Frame {
+        bool array = false;
+        size_t index = 0;
+        std::string key;    // ultima chiave letta, se è un oggetto
+    };
+
+    static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+    template <typename Handler>
+    const char* step(const char* p, const char* end, Handler& handler) {
+        char c = *p;
+        switch (state_) {
+            case State::Value:
+            case State::ArrayStart:
+                if (isSpace(c)) {
+                    return p + 1;
+                }
+                if (c == ']' && state_ == State::ArrayStart) {
+                    close(true, handler);
+                    return p + 1;
+                }
+                return beginValue(p, handler);
+
+            case State::ObjectStart:
+            case State::Key:
+                if (isSpace(c)) {
+                    return p + 1;
+                }
+                if (c == '}' && state_ == State::ObjectStart) {
+                    close(false, handler);
+                    return p + 1;
+                }
+                if (c != '"') {
+                    return fail(end);
+                }
+                inKey_ = true;
+                token_.clear();
+                state_ = State::String;
+                return p + 1;
+
+            case State::Colon:
+                if (isSpace(c)) {
+                    return p + 1;
+                }
+                if (c != ':') {
+                    return fail(end);
+                }
+                state_ = State::Value;
+                return p + 1;
+
+            case State::AfterValue:
+                if (isSpace(c)) {
+                    return p + 1;
+                }
+                if (c == ',') {
+                    Frame& frame = frames_[depth_ - 1];
+                    if (frame.array) {
+                        frame.index++;
+                        state_ = State::Value;
+                    } else {
+                        state_ = State::Key;
+                    }
+                    return p + 1;
+                }
+                if (c == ']' || c == '}') {
+                    if (frames_[depth_ - 1].array != (c == ']')) {
+                        return fail(end);
+                    }
+                    close(c == ']', handler);
+                    return p + 1;
+                }
+                return fail(end);
+
+            case State::String: {
+                // Il testo senza escape si copia a blocchi
+                const char* run = p;
+                while (run < end && *run != '"' && *run != '\\' && static_cast<unsigned char>(*run) >= 0x20) {
+                    run++;
+                }
+                if (run > p) {
+                    flushSurrogate();
+                    token_.append(p, static_cast<size_t>(run - p));
+                }
+                if (run == end) {
+                    return end;
+                }
+                if (*run == '\\') {
+                    state_ = State::Escape;
+                    return run + 1;
+                }
+                if (*run != '"') {
+                    return fail(end);
+                }
+                endString(handler);
+                return run + 1;
+            }
+
+            case State::Escape:
+                return escape(p, end);
+
+            case State::Unicode: {
+                int digit = hexDigit(c);
+                if (digit < 0) {
+                    return fail(end);
+                }
+                unicode_ = unicode_ * 16 + static_cast<uint32_t>(digit);
+                if (++unicodeDigits_ == 4) {
+                    appendCodePoint();
+                    state_ = State::String;
+                }
+                return p + 1;
+            }
+
+            case State::Number:
+                if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+                    token_ += c;
+                    return p + 1;
+                }
+                endNumber(handler);
+                return p;   // il carattere appartiene a ciò che segue il numero
+
+            case State::Literal:
+                if (c != literal_[literalPos_]) {
+                    return fail(end);
+                }
+                if (literal_[++literalPos_] == '\0') {
+                    handler(*this, literalToken_, std::string_view());
+                    endValue();
+                }
+                return p + 1;
+
+            case State::Done:
+                return isSpace(c) ? p + 1 : fail(end);
+
+            case State::Error:
+                break;
+        }
+        return end;
+    }
+
+    template <typename Handler>
+    const char* beginValue(const char* p, Handler& handler) {
+        char c = *p;
+        switch (c) {
+            case '{':
+            case '[':
+                handler(*this, c == '{' ? JsonToken::BeginObject : JsonToken::BeginArray, std::string_view());
+                if (depth_ == kMaxDepth) {
+                    return fail(p + 1);
+                }
+                if (frames_.size() == depth_) {
+                    frames_.emplace_back();
+                }
+                frames_[depth_].array = (c == '[');
+                frames_[depth_].index = 0;
+                frames_[depth_].key.clear();
+                depth_++;
+                state_ = c == '{' ? State::ObjectStart : State::ArrayStart;
+                return p + 1;
+            case '"':
+                inKey_ = false;
+                token_.clear();
+                state_ = State::String;
+                return p + 1;
+            case 't': return beginLiteral(p, "true", JsonToken::True);
+            case 'f': return beginLiteral(p, "false", JsonToken::False);
+            case 'n': return beginLiteral(p, "null", JsonToken::Null);
+            default:
+                if (c == '-' || (c >= '0' && c <= '9')) {
+                    token_.assign(1, c);
+                    state_ = State::Number;
+                    return p + 1;
+                }
+                return fail(p + 1);
+        }
+    }
+
+    const char* beginLiteral(const char* p, const char* literal, JsonToken token) {
+        literal_ = literal;
+        literalPos_ = 1;
+        literalToken_ = token;
+        state_ = State::Literal;
+        return p + 1;
+    }
+
+    const char* escape(const char* p, const char* end) {
+        char decoded;
+        switch (*p) {
+            case '"': decoded = '"'; break;
+            case '\\': decoded = '\\'; break;
+            case '/': decoded = '/'; break;
+            case 'b': decoded = '\b'; break;
+            case 'f': decoded = '\f'; break;
+            case 'n': decoded = '\n'; break;
+            case 'r': decoded = '\r'; break;
+            case 't': decoded = '\t'; break;
+            case 'u':
+                unicode_ = 0;
+                unicodeDigits_ = 0;
+                state_ = State::Unicode;
+                return p + 1;
+            default:
+                return fail(end);
+        }
+        flushSurrogate();
+        token_ += decoded;
+        state_ = State::String;
+        return p + 1;
+    }
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // \uXXXX in UTF-8; le coppie surrogate diventano un solo carattere
+    void appendCodePoint() {
+        uint32_t code = unicode_;
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            flushSurrogate();
+            highSurrogate_ = code;
+            return;
+        }
+        if (code >= 0xDC00 && code <= 0xDFFF) {
+            if (highSurrogate_ == 0) {
+                appendUtf8(0xFFFD);
+                return;
+            }
+            code = 0x10000 + ((highSurrogate_ - 0xD800) << 10) + (code - 0xDC00);
+            highSurrogate_ = 0;
+        } else {
+            flushSurrogate();
+        }
+        appendUtf8(code);
+    }
+
+    // Surrogato alto senza il basso: carattere sostitutivo
+    void flushSurrogate() {
+        if (highSurrogate_ != 0) {
+            highSurrogate_ = 0;
+            appendUtf8(0xFFFD);
+        }
+    }
+
+    void appendUtf8(uint32_t code) {
+        if (code < 0x80) {
+            token_ += static_cast<char>(code);
+        } else if (code < 0x800) {
+            token_ += static_cast<char>(0xC0 | (code >> 6));
+            token_ += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            token_ += static_cast<char>(0xE0 | (code >> 12));
+            token_ += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            token_ += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            token_ += static_cast<char>(0xF0 | (code >> 18));
+            token_ += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            token_ += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            token_ += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    template <typename Handler>
+    void endString(Handler& handler) {
+        flushSurrogate();
+        if (inKey_) {
+            frames_[depth_ - 1].key.assign(token_);
+            state_ = State::Colon;
+            return;
+        }
+        handler(*this, JsonToken::String, std::string_view(token_));
+        endValue();
+    }
+
+    template <typename Handler>
+    void endNumber(Handler& handler) {
+        if (!validNumber(token_)) {
+            state_ = State::Error;
+            return;
+        }
+        handler(*this, JsonToken::Number, std::string_view(token_));
+        endValue();
+    }
+
+    // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    static bool validNumber(std::string_view text) {
+        size_t i = 0;
+        auto digits = [&text, &i] {
+            size_t start = i;
+            while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+                i++;
+            }
+            return i > start;
+        };
+        if (i < text.size() && text[i] == '-') {
+            i++;
+        }
+        if (i < text.size() && text[i] == '0') {
+            i++;
+        } else if (!digits()) {
+            return false;
+        }
+        if (i < text.size() && text[i] == '.') {
+            i++;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+            i++;
+            if (i < text.size() && (text[i] == '+' || text[i] == '-')) {
+                i++;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return i == text.size();
+    }
+
+    // La chiusura si segnala con il percorso del contenitore, come l'apertura
+    template <typename Handler>
+    void close(bool array, Handler& handler) {
+        depth_--;
+        handler(*this, array ? JsonToken::EndArray : JsonToken::EndObject, std::string_view());
+        endValue();
+    }
+
+    void endValue() {
+        state_ = depth_ == 0 ? State::Done : State::AfterValue;
+    }
+
+    const char* fail(const char* end) {
+        state_ = State::Error;
+        return end;
+    }
+
+    State state_ = State::Value;
+    std::vector<Frame> frames_;
+    size_t depth_ = 0;
+    std::string token_;         // stringa o numero in lettura, anche tra due pezzi
+    bool inKey_ = false;
+    uint32_t unicode_ = 0;
+    int unicodeDigits_ = 0;
+    uint32_t highSurrogate_ = 0;
+    const char* literal_ = nullptr;
+    size_t literalPos_ = 0;
+    JsonToken literalToken_ = JsonToken::Null;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+// Funzioni di formattazione JSON che scrivono in coda a un buffer esistente.
+// L'output è identico a quello di nlohmann::json::dump() per gli stessi valori:
+// numeri in virgola mobile con lo stesso algoritmo (Grisu2) e le stesse regole
+// (".0" sugli interi, esponente fuori da 1e-4..1e15), stesse sequenze di escape.
+namespace jsonfmt {
+
+inline void appendNumber(std::string& out, double value) {
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char buffer[64];
+    char* end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, static_cast<size_t>(end - buffer));
+}
+
+inline void appendNumber(std::string& out, int64_t value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, static_cast<size_t>(result.ptr - buffer));
+}
+
+inline void appendNumber(std::string& out, int value) { appendNumber(out, static_cast<int64_t>(value)); }
+
+// Contenuto di una stringa JSON, senza virgolette. L'UTF-8 passa invariato
+// (come con ensure_ascii = false) e non viene validato
+inline void appendEscaped(std::string& out, std::string_view value) {
+    static constexpr char hex[] = "0123456789abcdef";
+    size_t plain = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        auto c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(value.data() + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+                out.append(escape, sizeof(escape));
+            }
+        }
+    }
+    out.append(value.data() + plain, value.size() - plain);
+}
+
+inline void appendString(std::string& out, std::string_view value) {
+    out += '"';
+    appendEscaped(out, value);
+    out += '"';
+}
+
+}  // namespace jsonfmt
+
+// Scrittura JSON in streaming in un buffer riusabile: nessun DOM intermedio.
+// Le chiavi vanno scritte nell'ordine voluto nell'output (per riprodurre
+// dump() di nlohmann::json, in ordine alfabetico).
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+
+    JsonWriter& beginObject() { separator(); out_ += '{'; needComma_ = false; return *this; }
+    JsonWriter& endObject() { out_ += '}'; needComma_ = true; return *this; }
+    JsonWriter& beginArray() { separator(); out_ += '['; needComma_ = false; return *this; }
+    JsonWriter& endArray() { out_ += ']'; needComma_ = true; return *this; }
+
+    JsonWriter& key(std::string_view name) {
+        separator();
+        jsonfmt::appendString(out_, name);
+        out_ += ':';
+        needComma_ = false;
+        return *this;
+    }
+
+    JsonWriter& value(std::string_view text) { separator(); jsonfmt::appendString(out_, text); needComma_ = true; return *this; }
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(double number) { separator(); jsonfmt::appendNumber(out_, number); needComma_ = true; return *this; }
+    JsonWriter& value(int64_t number) { separator(); jsonfmt::appendNumber(out_, number); needComma_ = true; return *this; }
+    JsonWriter& value(int number) { return value(static_cast<int64_t>(number)); }
+    JsonWriter& value(bool flag) { separator(); out_ += flag ? "true" : "false"; needComma_ = true; return *this; }
+    // Valore già serializzato (es. il corpo JSON di una risposta), copiato così com'è
+    JsonWriter& raw(std::string_view json) { separator(); out_.append(json); needComma_ = true; return *this; }
+
+    // Coppia chiave-valore
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& fieldValue) { return key(name).value(fieldValue); }
+
+private:
+    void separator() {
+        if (needComma_) {
+            out_ += ',';
+        }
+    }
+
+    std::string& out_;
+    bool needComma_ = false;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "metrics.hpp"
+
+// Arena per gli oggetti di breve vita di un messaggio (DOM JSON delle risposte,
+// risposta pubblicata): le allocazioni avanzano un puntatore in blocchi da 16 KiB
+// presi da un pool del thread, la deallocazione dei singoli oggetti non fa nulla
+// e reset() restituisce i blocchi al pool in un colpo solo. A regime un
+// messaggio non chiama malloc per il DOM. Non è thread-safe: un'arena appartiene
+// al thread del suo event loop.
+class MessageArena {
+public:
+    static constexpr size_t kBlockSize = 16 * 1024;
+
+    MessageArena() = default;
+    ~MessageArena() { reset(); }
+
+    MessageArena(const MessageArena&) = delete;
+    MessageArena& operator=(const MessageArena&) = delete;
+
+    void* allocate(size_t size, size_t alignment) {
+        uintptr_t aligned = (cursor_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        if (blocks_.empty() || aligned + size > limit_) {
+            // Le allocazioni grandi hanno un blocco proprio, che non entra nel pool
+            size_t blockSize = std::max(kBlockSize, size + alignment);
+            blocks_.push_back(blockSize == kBlockSize ? takeBlock() : Block(new char[blockSize]));
+            sizes_.push_back(blockSize);
+            cursor_ = reinterpret_cast<uintptr_t>(blocks_.back().get());
+            limit_ = cursor_ + blockSize;
+            aligned = (cursor_ + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        }
+        cursor_ = aligned + size;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    bool owns(const void* pointer) const {
+        auto address = reinterpret_cast<uintptr_t>(pointer);
+        for (size_t i = 0; i < blocks_.size(); i++) {
+            auto begin = reinterpret_cast<uintptr_t>(blocks_[i].get());
+            if (address >= begin && address < begin + sizes_[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Libera tutto ciò che è stato allocato: gli oggetti nell'arena non vanno più usati
+    void reset() {
+        for (size_t i = 0; i < blocks_.size(); i++) {
+            if (sizes_[i] == kBlockSize) {
+                returnBlock(std::move(blocks_[i]));
+            }
+        }
+        blocks_.clear();
+        sizes_.clear();
+        cursor_ = limit_ = 0;
+    }
+
+private:
+    using Block = std::unique_ptr<char[]>;
+
+    // Blocchi liberi del thread, tenuti entro un limite per non trattenere memoria
+    static std::vector<Block>& freeBlocks() {
+        thread_local std::vector<Block> blocks;
+        return blocks;
+    }
+
+    static Block takeBlock() {
+        auto& pool = freeBlocks();
+        if (pool.empty()) {
+            static Counter& allocated = metrics().counter("ow_arena_blocks_allocated_total",
+                                                          "Blocchi di arena allocati perché il pool del thread era vuoto");
+            allocated.add();
+            return Block(new char[kBlockSize]);
+        }
+        Block block = std::move(pool.back());
+        pool.pop_back();
+        return block;
+    }
+
+    static void returnBlock(Block block) {
+        auto& pool = freeBlocks();
+        if (pool.size() < 256) {
+            pool.push_back(std::move(block));
+        }
+    }
+
+    std::vector<Block> blocks_;
+    std::vector<size_t> sizes_;
+    uintptr_t cursor_ = 0;
+    uintptr_t limit_ = 0;
+};
+
+// Arena corrente del thread, usata da ArenaAllocator finché lo scope è attivo
+class ArenaScope {
+public:
+    explicit ArenaScope(MessageArena& arena) : previous_(current()) { current() = &arena; }
+    ~ArenaScope() { current() = previous_; }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+    static MessageArena*& current() {
+        thread_local MessageArena* arena = nullptr;
+        return arena;
+    }
+
+private:
+    MessageArena* previous_;
+};
+
+// Allocatore senza stato (come richiede nlohmann::basic_json) che alloca
+// nell'arena dello scope corrente, o sullo heap se non ce n'è una.
+// Gli oggetti allocati nell'arena vanno distrutti prima che lo scope finisca
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t count) {
+        if (MessageArena* arena = ArenaScope::current()) {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        MessageArena* arena = ArenaScope::current();
+        if (!arena || !arena->owns(pointer)) {
+            ::operator delete(pointer);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>&) const { return false; }
+};
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// DOM JSON interamente nell'arena: nodi, oggetti, array e stringhe.
+// dump() restituisce un ArenaString, da copiare se deve sopravvivere allo scope
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, ArenaString, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
+
+// Testo del DOM come std::string, utilizzabile anche dopo lo scope
+inline std::string dumpJson(const ArenaJson& json) {
+    ArenaString text = json.dump();
+    return std::string(text.data(), text.size());
+}
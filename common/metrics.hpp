@@ -0,0 +1,511 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "config.hpp"
+
+// Metriche del processo in formato Prometheus. Contatori e istogrammi sono
+// divisi in shard per thread: ogni event loop incrementa i propri slot con
+// operazioni atomiche relaxed, senza lock né contesa sulle cache line.
+// Gli shard vengono sommati solo quando l'endpoint /metrics viene letto.
+
+constexpr size_t kMetricShards = 16;
+
+inline size_t metricShard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+    return shard;
+}
+
+using MetricsClock = std::chrono::steady_clock;
+
+inline uint64_t elapsedMicros(MetricsClock::time_point since) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(MetricsClock::now() - since).count());
+}
+
+class Counter {
+public:
+    void add(uint64_t n = 1) {
+        slots_[metricShard()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t total = 0;
+        for (const auto& slot : slots_) total += slot.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Slot, kMetricShards> slots_;
+};
+
+// Istogramma delle latenze in microsecondi, log-lineare come HdrHistogram:
+// 16 sotto-bucket per ogni potenza di due (errore relativo massimo 6%),
+// valori esatti sotto i 16 µs, fino a circa 38 ore
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBits;
+    static constexpr int kMaxExponent = 36;
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+    void record(uint64_t micros) {
+        Shard& shard = shards_[metricShard()];
+        shard.buckets[bucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(micros, std::memory_order_relaxed);
+    }
+
+    void recordSince(MetricsClock::time_point start) { record(elapsedMicros(start)); }
+
+    struct Snapshot {
+        std::vector<uint64_t> buckets;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        // Limite superiore del bucket che contiene il quantile q
+        uint64_t quantile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count - 1)) + 1;
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets.size(); i++) {
+                seen += buckets[i];
+                if (seen >= rank) return bucketUpperBound(i) - 1;
+            }
+            return bucketUpperBound(buckets.size() - 1) - 1;
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot result;
+        result.buckets.assign(kBuckets, 0);
+        for (const auto& shard : shards_) {
+            for (size_t i = 0; i < kBuckets; i++) {
+                uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+                result.buckets[i] += n;
+                result.count += n;
+            }
+            result.sum += shard.sum.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    static size_t bucketIndex(uint64_t micros) {
+        if (micros < kSubBuckets) {
+            return static_cast<size_t>(micros);
+        }
+        int exponent = 63 - __builtin_clzll(micros);
+        if (exponent > kMaxExponent) {
+            return kBuckets - 1;
+        }
+        uint64_t sub = (micros >> (exponent - kSubBits)) & (kSubBuckets - 1);
+        return static_cast<size_t>(exponent - kSubBits + 1) * kSubBuckets + sub;
+    }
+
+    // Primo valore escluso dal bucket
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < kSubBuckets) {
+            return index + 1;
+        }
+        int shift = static_cast<int>(index / kSubBuckets) - 1;
+        uint64_t sub = index % kSubBuckets;
+        return ((kSubBuckets + sub) << shift) + (uint64_t(1) << shift);
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kBuckets> buckets{};
+        std::atomic<uint64_t> sum{0};
+    };
+    std::array<Shard, kMetricShards> shards_;
+};
+
+class MetricsRegistry;
+
+// Registrazione di una sonda: la rimuove quando viene distrutta
+class ProbeHandle {
+public:
+    ProbeHandle() = default;
+    ProbeHandle(MetricsRegistry* registry, uint64_t id) : registry_(registry), id_(id) {}
+    ProbeHandle(ProbeHandle&& other) noexcept : registry_(other.registry_), id_(other.id_) { other.registry_ = nullptr; }
+    ProbeHandle& operator=(ProbeHandle&& other) noexcept;
+    ProbeHandle(const ProbeHandle&) = delete;
+    ProbeHandle& operator=(const ProbeHandle&) = delete;
+    ~ProbeHandle();
+
+private:
+    MetricsRegistry* registry_ = nullptr;
+    uint64_t id_ = 0;
+};
+
+// Registro delle metriche del processo. La registrazione usa un mutex ed è
+// pensata per l'avvio: i chiamanti conservano il riferimento restituito
+class MetricsRegistry {
+public:
+    // labels già in formato Prometheus, es. stage="parse"
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Family& family = familyFor(name, help, "counter");
+        auto& slot = family.counters[labels];
+        if (!slot) slot = std::make_unique<Counter>();
+        return *slot;
+    }
+
+    LatencyHistogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Family& family = familyFor(name, help, "histogram");
+        auto& slot = family.histograms[labels];
+        if (!slot) slot = std::make_unique<LatencyHistogram>();
+        return *slot;
+    }
+
+    // Valore letto al momento dell'esportazione (es. i contatori già esistenti
+    // di cache e client HTTP). Le sonde con stesso nome ed etichette, una per
+    // event loop, vengono sommate. read deve essere thread-safe
+    ProbeHandle probe(const std::string& name, const std::string& help, const std::string& type,
+                      const std::string& labels, std::function<double()> read) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Family& family = familyFor(name, help, type);
+        uint64_t id = ++nextProbe_;
+        family.probes[id] = Probe{labels, std::move(read)};
+        probeFamilies_[id] = name;
+        return ProbeHandle(this, id);
+    }
+
+    void removeProbe(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = probeFamilies_.find(id);
+        if (it == probeFamilies_.end()) return;
+        families_[it->second].probes.erase(id);
+        probeFamilies_.erase(it);
+    }
+
+    // Esposizione in formato testo Prometheus 0.0.4
+    std::string render() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string out;
+        out.reserve(16384);
+        for (const auto& [name, family] : families_) {
+            if (family.counters.empty() && family.histograms.empty() && family.probes.empty()) continue;
+            out += "# HELP " + name + " " + family.help + "\n";
+            out += "# TYPE " + name + " " + family.type + "\n";
+
+            for (const auto& [labels, counter] : family.counters) {
+                appendSample(out, name, labels, static_cast<double>(counter->value()));
+            }
+
+            std::map<std::string, double> probes;
+            for (const auto& entry : family.probes) {
+                probes[entry.second.labels] += entry.second.read();
+            }
+            for (const auto& [labels, value] : probes) {
+                appendSample(out, name, labels, value);
+            }
+
+            std::string quantiles;
+            for (const auto& [labels, histogram] : family.histograms) {
+                appendHistogram(out, quantiles, name, labels, histogram->snapshot());
+            }
+            if (!quantiles.empty()) {
+                out += "# HELP " + name + "_quantile Quantili di " + name + " a piena risoluzione\n";
+                out += "# TYPE " + name + "_quantile gauge\n";
+                out += quantiles;
+            }
+        }
+        return out;
+    }
+
+private:
+    struct Probe {
+        std::string labels;
+        std::function<double()> read;
+    };
+
+    struct Family {
+        std::string help;
+        std::string type;
+        std::map<std::string, std::unique_ptr<Counter>> counters;
+        std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+        std::map<uint64_t, Probe> probes;
+    };
+
+    Family& familyFor(const std::string& name, const std::string& help, const std::string& type) {
+        Family& family = families_[name];
+        if (family.type.empty()) {
+            family.help = help;
+            family.type = type;
+        }
+        return family;
+    }
+
+    static void appendSample(std::string& out, const std::string& name, const std::string& labels, double value) {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.9g", value);
+        out += name;
+        if (!labels.empty()) out += "{" + labels + "}";
+        out += " ";
+        out += number;
+        out += "\n";
+    }
+
+    // I bucket fini vengono riassunti su limiti fissi in secondi, uguali per
+    // tutti gli istogrammi; i quantili usano la risoluzione piena e sono
+    // esportati a parte come gauge <nome>_quantile
+    static void appendHistogram(std::string& out, std::string& quantiles, const std::string& name, const std::string& labels,
+                                const LatencyHistogram::Snapshot& snapshot) {
+        static const double limits[] = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+                                        0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        char le[32];
+        for (double limit : limits) {
+            auto limitMicros = static_cast<uint64_t>(limit * 1e6 + 0.5);
+            while (bucket < snapshot.buckets.size() && LatencyHistogram::bucketUpperBound(bucket) - 1 <= limitMicros) {
+                cumulative += snapshot.buckets[bucket++];
+            }
+            std::snprintf(le, sizeof(le), "le=\"%g\"", limit);
+            appendSample(out, name + "_bucket", labels.empty() ? std::string(le) : labels + "," + le, static_cast<double>(cumulative));
+        }
+        appendSample(out, name + "_bucket", labels.empty() ? "le=\"+Inf\"" : labels + ",le=\"+Inf\"", static_cast<double>(snapshot.count));
+        appendSample(out, name + "_sum", labels, static_cast<double>(snapshot.sum) / 1e6);
+        appendSample(out, name + "_count", labels, static_cast<double>(snapshot.count));
+
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            char quantile[32];
+            std::snprintf(quantile, sizeof(quantile), "quantile=\"%g\"", q);
+            std::string quantileLabels = labels.empty() ? std::string(quantile) : labels + "," + quantile;
+            appendSample(quantiles, name + "_quantile", quantileLabels, static_cast<double>(snapshot.quantile(q)) / 1e6);
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+    std::map<uint64_t, std::string> probeFamilies_;
+    uint64_t nextProbe_ = 0;
+};
+
+inline MetricsRegistry& metrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+// Oggetto di processo per chiave (upstream o servizio), condiviso da tutti gli
+// event loop e costruito con T(key) al primo uso. Il registro delle metriche
+// viene creato prima della mappa, così le sopravvive e le sonde degli oggetti
+// si possono rimuovere all'uscita
+template <typename T>
+T& processSingleton(const std::string& key) {
+    metrics();
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<T>> instances;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = instances[key];
+    if (!slot) {
+        slot = std::make_unique<T>(key);
+    }
+    return *slot;
+}
+
+inline ProbeHandle& ProbeHandle::operator=(ProbeHandle&& other) noexcept {
+    if (this != &other) {
+        if (registry_) registry_->removeProbe(id_);
+        registry_ = other.registry_;
+        id_ = other.id_;
+        other.registry_ = nullptr;
+    }
+    return *this;
+}
+
+inline ProbeHandle::~ProbeHandle() {
+    if (registry_) registry_->removeProbe(id_);
+}
+
+// Latenza di una fase dell'elaborazione di un messaggio
+inline LatencyHistogram& stageLatency(const std::string& stage) {
+    return metrics().histogram("ow_stage_latency_seconds", "Latenza per fase di elaborazione dei messaggi",
+                               "stage=\"" + stage + "\"");
+}
+
+inline Counter& messageCounter(const std::string& result) {
+    return metrics().counter("ow_messages_total", "Messaggi elaborati per esito", "result=\"" + result + "\"");
+}
+
+// Fasi comuni dei worker: attesa nella finestra, parsing dell'input,
+// costruzione del body, chiamata upstream (cache compresa), publish della
+// risposta e tempo totale dalla ricezione all'ack
+struct WorkerStages {
+    LatencyHistogram& wait = stageLatency("wait");
+    LatencyHistogram& parse = stageLatency("parse");
+    LatencyHistogram& build = stageLatency("build");
+    LatencyHistogram& upstream = stageLatency("upstream");
+    LatencyHistogram& publish = stageLatency("publish");
+    LatencyHistogram& total = stageLatency("total");
+    Counter& ok = messageCounter("ok");
+    Counter& errors = messageCounter("error");
+    Counter& expired = messageCounter("expired");
+};
+
+inline WorkerStages& workerStages() {
+    static WorkerStages stages;
+    return stages;
+}
+
+// Misura la durata dello scope corrente
+class StageTimer {
+public:
+    explicit StageTimer(LatencyHistogram& histogram) : histogram_(histogram), start_(MetricsClock::now()) {}
+    ~StageTimer() { histogram_.recordSince(start_); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    LatencyHistogram& histogram_;
+    MetricsClock::time_point start_;
+};
+
+// Fasi di una chiamata HTTP verso un upstream, da curl_easy_getinfo
+struct UpstreamMetrics {
+    LatencyHistogram& dns;
+    LatencyHistogram& connect;
+    LatencyHistogram& tls;
+    LatencyHistogram& ttfb;
+    LatencyHistogram& total;
+    Counter& requests;
+    Counter& errors;
+};
+
+inline UpstreamMetrics& upstreamMetrics(const std::string& upstream) {
+    static std::mutex mutex;
+    static std::map<std::string, std::unique_ptr<UpstreamMetrics>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = cache[upstream];
+    if (!slot) {
+        auto phase = [&upstream](const char* name) -> LatencyHistogram& {
+            return metrics().histogram("ow_upstream_latency_seconds", "Latenza delle chiamate HTTP upstream per fase",
+                                       "upstream=\"" + upstream + "\",phase=\"" + name + "\"");
+        };
+        std::string labels = "upstream=\"" + upstream + "\"";
+        slot.reset(new UpstreamMetrics{
+            phase("dns"), phase("connect"), phase("tls"), phase("ttfb"), phase("total"),
+            metrics().counter("ow_upstream_requests_total", "Chiamate HTTP upstream", labels),
+            metrics().counter("ow_upstream_errors_total", "Chiamate HTTP upstream fallite a livello di trasporto", labels)});
+    }
+    return *slot;
+}
+
+// Connessione all'endpoint delle metriche. Il timer chiude la connessione se
+// la richiesta o la lettura della risposta non finiscono entro il timeout,
+// così un client lento o muto non blocca le letture degli altri
+class MetricsSession : public std::enable_shared_from_this<MetricsSession> {
+public:
+    MetricsSession(boost::asio::ip::tcp::socket socket, std::chrono::milliseconds timeout)
+        : socket_(std::move(socket)), timer_(socket_.get_executor()), timeout_(timeout), request_(8192) {}
+
+    void start() {
+        auto self = shared_from_this();
+        timer_.expires_after(timeout_);
+        timer_.async_wait([this, self](const boost::system::error_code& ec) {
+            if (!ec) {
+                boost::system::error_code ignored;
+                socket_.close(ignored);
+            }
+        });
+        boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+            [this, self](const boost::system::error_code& ec, size_t) {
+                if (ec) {
+                    timer_.cancel();
+                    return;
+                }
+                respond();
+            });
+    }
+
+private:
+    void respond() {
+        std::string requestLine(boost::asio::buffers_begin(request_.data()), boost::asio::buffers_end(request_.data()));
+        std::string body;
+        std::string status;
+        if (requestLine.rfind("GET /metrics", 0) == 0) {
+            status = "200 OK";
+            body = metrics().render();
+        } else {
+            status = "404 Not Found";
+        }
+        response_ = "HTTP/1.1 " + status + "\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                    "Connection: close\r\n\r\n" + body;
+
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(response_),
+            [this, self](const boost::system::error_code&, size_t) {
+                timer_.cancel();
+                boost::system::error_code ignored;
+                socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            });
+    }
+
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    std::chrono::milliseconds timeout_;
+    boost::asio::streambuf request_;
+    std::string response_;
+};
+
+// Endpoint HTTP locale con le metriche, su un thread e un io_context dedicati
+// per non interferire con gli event loop; le connessioni sono servite in modo
+// asincrono. La porta è in "metrics.ports.<servizio>" della configurazione
+// (OW_METRICS_PORT la sovrascrive); 0 disabilita.
+inline void startMetricsServer(const std::string& service) {
+    const auto& settings = config().value("metrics", nlohmann::json::object());
+    std::string address = settings.value("address", std::string("127.0.0.1"));
+    unsigned port = settings.value("ports", nlohmann::json::object()).value(service, 0u);
+    std::chrono::milliseconds timeout(settings.value("request_timeout_ms", 5000));
+    if (const char* env = std::getenv("OW_METRICS_PORT")) {
+        port = static_cast<unsigned>(std::strtoul(env, nullptr, 10));
+    }
+    if (port == 0) {
+        return;
+    }
+
+    std::thread([address, port, timeout] {
+        try {
+            boost::asio::io_context io_context;
+            boost::asio::ip::tcp::acceptor acceptor(
+                io_context, {boost::asio::ip::make_address(address), static_cast<unsigned short>(port)});
+            std::cout << "Metriche disponibili su http://" << address << ":" << port << "/metrics" << std::endl;
+
+            std::function<void()> accept = [&] {
+                acceptor.async_accept([&](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+                    if (!ec) {
+                        std::make_shared<MetricsSession>(std::move(socket), timeout)->start();
+                    }
+                    accept();
+                });
+            };
+            accept();
+            io_context.run();
+        } catch (const std::exception& e) {
+            std::cerr << "Endpoint delle metriche non disponibile: " << e.what() << std::endl;
+        }
+    }).detach();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <amqpcpp.h>
+
+// Pseudo-coda "direct reply-to" di RabbitMQ: chi chiama la consuma (no-ack) e
+// la indica come reply_to; il broker la sostituisce con un nome
+// amq.rabbitmq.reply-to.* che porta la risposta direttamente al suo canale,
+// senza passare da una coda
+inline const std::string kDirectReplyTo = "amq.rabbitmq.reply-to";
+
+// Coda della risposta: il reply_to del messaggio (anche direct reply-to) o,
+// se manca, la coda di output del servizio
+inline const std::string& replyQueue(const AMQP::MetaData& message, const std::string& outputQueue) {
+    return message.hasReplyTo() ? message.replyTo() : outputQueue;
+}
+
+// Pubblica la risposta di un worker conservando il correlation_id della
+// richiesta, così chi l'ha inviata può associarla alla propria richiesta
+inline void publishReply(AMQP::Channel& channel, const std::string& queue,
+                         const std::string& body, const std::string& correlationId) {
+    AMQP::Envelope envelope(body.data(), body.size());
+    if (!correlationId.empty()) {
+        envelope.setCorrelationID(correlationId);
+    }
+    channel.publish("", queue, envelope);
+}
+
+// Messaggio che per ora non si può elaborare (upstream non disponibile): alla
+// prima consegna torna al broker, se era già stato riconsegnato riceve body.
+// Restituisce true se il messaggio è stato rimesso in coda
+inline bool requeueOrReply(AMQP::Channel& channel, uint64_t deliveryTag, bool redelivered, const std::string& queue,
+                           const std::string& body, const std::string& correlationId) {
+    if (!redelivered) {
+        channel.reject(deliveryTag, AMQP::requeue);
+        return true;
+    }
+    publishReply(channel, queue, body, correlationId);
+    channel.ack(deliveryTag);
+    return false;
+}
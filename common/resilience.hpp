@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include "config.hpp"
+#include "metrics.hpp"
+
+// Protezione degli upstream (gateway di pagamento e vettori): limite di
+// richieste per chiave API e circuit breaker per upstream. I messaggi che non
+// possono partire vengono trattenuti finché l'upstream li accetta e, oltre
+// max_defer_ms, rimessi in coda invece di consumare connessioni.
+
+// Sezione "resilience" della configurazione: la voce "default" vale per tutti
+// gli upstream, la voce con il nome dell'upstream la sovrascrive
+struct ResilienceSettings {
+    double ratePerSec = 0;            // richieste al secondo per chiave API (0 = nessun limite)
+    double burst = 0;                 // richieste consentite di seguito (0 = ratePerSec)
+    size_t maxKeys = 10000;           // chiavi API con un limite attivo
+    double failureThreshold = 0.5;    // frazione di errori che apre il circuito
+    uint64_t minRequests = 20;        // richieste minime nella finestra per valutarla
+    long windowMs = 10000;
+    long openMs = 5000;               // durata del circuito aperto prima delle prove
+    uint64_t halfOpenProbes = 3;      // prove riuscite necessarie per richiudere
+    long maxDeferMs = 2000;           // attesa massima di un messaggio prima di rimetterlo in coda
+};
+
+inline ResilienceSettings resilienceSettings(const std::string& upstream) {
+    ResilienceSettings settings;
+    const auto& sections = config().value("resilience", nlohmann::json::object());
+
+    for (const char* key : {"default", upstream.c_str()}) {
+        auto it = sections.find(key);
+        if (it == sections.end()) {
+            continue;
+        }
+        settings.ratePerSec = it->value("rate_per_sec", settings.ratePerSec);
+        settings.burst = it->value("burst", settings.burst);
+        settings.maxKeys = it->value("max_keys", settings.maxKeys);
+        settings.failureThreshold = it->value("failure_threshold", settings.failureThreshold);
+        settings.minRequests = it->value("min_requests", settings.minRequests);
+        settings.windowMs = it->value("window_ms", settings.windowMs);
+        settings.openMs = it->value("open_ms", settings.openMs);
+        settings.halfOpenProbes = it->value("half_open_probes", settings.halfOpenProbes);
+        settings.maxDeferMs = it->value("max_defer_ms", settings.maxDeferMs);
+    }
+
+    if (settings.burst <= 0) {
+        settings.burst = std::max(1.0, settings.ratePerSec);
+    }
+    settings.windowMs = std::max(1000L, settings.windowMs);
+    settings.halfOpenProbes = std::max<uint64_t>(1, settings.halfOpenProbes);
+    return settings;
+}
+
+// Errori che indicano un upstream in difficoltà: richiesta non riuscita
+// (status 0), limite superato o errore del server. Gli altri 4xx sono
+// errori della singola richiesta e non aprono il circuito.
+inline bool upstreamFailure(long status) {
+    return status == 0 || status == 429 || status >= 500;
+}
+
+// Token bucket: ratePerSec token al secondo, al massimo burst accumulati
+class TokenBucket {
+public:
+    TokenBucket(double ratePerSec, double burst, MetricsClock::time_point now)
+        : ratePerSec_(ratePerSec), burst_(burst), tokens_(burst), updated_(now) {}
+
+    // Preleva un token; se non c'è restituisce l'attesa fino al prossimo
+    MetricsClock::duration take(MetricsClock::time_point now) {
+        refill(now);
+        if (tokens_ >= 1) {
+            tokens_ -= 1;
+            return MetricsClock::duration::zero();
+        }
+        return std::chrono::duration_cast<MetricsClock::duration>(std::chrono::duration<double>((1 - tokens_) / ratePerSec_));
+    }
+
+    // Dopo un 429 l'upstream ha già esaurito la sua quota: si riparte da zero
+    void drain(MetricsClock::time_point now) {
+        refill(now);
+        tokens_ = 0;
+    }
+
+    bool idle(MetricsClock::time_point now) {
+        refill(now);
+        return tokens_ >= burst_;
+    }
+
+private:
+    void refill(MetricsClock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - updated_).count();
+        if (elapsed > 0) {
+            tokens_ = std::min(burst_, tokens_ + elapsed * ratePerSec_);
+            updated_ = now;
+        }
+    }
+
+    double ratePerSec_;
+    double burst_;
+    double tokens_;
+    MetricsClock::time_point updated_;
+};
+
+// Circuit breaker su una finestra scorrevole di esiti, divisa in intervalli
+// di un secondo. Chiuso: tutto passa. Aperto: si fallisce subito per openMs.
+// Semiaperto: passano al più halfOpenProbes prove; un errore lo riapre,
+// altrettante prove riuscite lo richiudono.
+class CircuitBreaker {
+public:
+    enum class State { Closed = 0, HalfOpen = 1, Open = 2 };
+
+    explicit CircuitBreaker(const ResilienceSettings& settings)
+        : settings_(settings), slots_(static_cast<size_t>(settings.windowMs / 1000)) {}
+
+    // Zero se la chiamata può partire (probe indica una prova a circuito
+    // semiaperto), altrimenti l'attesa suggerita prima di riprovare
+    MetricsClock::duration admit(MetricsClock::time_point now, bool& probe) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        probe = false;
+        if (state_ == State::Open) {
+            if (now < reopenAt_) {
+                return reopenAt_ - now;
+            }
+            setState(State::HalfOpen);
+            probesInFlight_ = 0;
+            probeSuccesses_ = 0;
+        }
+        if (state_ == State::HalfOpen) {
+            if (probesInFlight_ + probeSuccesses_ >= settings_.halfOpenProbes) {
+                return std::chrono::milliseconds(std::max(50L, settings_.openMs / 10));
+            }
+            probesInFlight_++;
+            probe = true;
+        }
+        return MetricsClock::duration::zero();
+    }
+
+    void record(bool probe, bool failure, MetricsClock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (probe) {
+            // Prova di un periodo semiaperto precedente: non conta più
+            if (state_ != State::HalfOpen || probesInFlight_ == 0) {
+                return;
+            }
+            probesInFlight_--;
+            if (failure) {
+                open(now);
+            } else if (++probeSuccesses_ >= settings_.halfOpenProbes) {
+                setState(State::Closed);
+                std::fill(slots_.begin(), slots_.end(), Slot());
+            }
+            return;
+        }
+        // Esiti di chiamate partite prima dell'apertura: non contano più
+        if (state_ != State::Closed) {
+            return;
+        }
+
+        int64_t second = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        Slot& slot = slots_[static_cast<size_t>(second) % slots_.size()];
+        if (slot.second != second) {
+            slot = Slot{second, 0, 0};
+        }
+        slot.requests++;
+        slot.failures += failure ? 1 : 0;
+
+        uint64_t requests = 0, failures = 0;
+        for (const Slot& recent : slots_) {
+            if (second - recent.second < static_cast<int64_t>(slots_.size())) {
+                requests += recent.requests;
+                failures += recent.failures;
+            }
+        }
+        if (requests >= settings_.minRequests &&
+            static_cast<double>(failures) >= settings_.failureThreshold * static_cast<double>(requests)) {
+            open(now);
+        }
+    }
+
+    // Prova concessa ma non eseguita
+    void releaseProbe() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::HalfOpen && probesInFlight_ > 0) {
+            probesInFlight_--;
+        }
+    }
+
+    State state() const { return static_cast<State>(stateValue_.load(std::memory_order_relaxed)); }
+    uint64_t opened() const { return opened_.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        int64_t second = -1;
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+    };
+
+    void open(MetricsClock::time_point now) {
+        setState(State::Open);
+        reopenAt_ = now + std::chrono::milliseconds(settings_.openMs);
+        opened_++;
+    }
+
+    void setState(State state) {
+        state_ = state;
+        stateValue_.store(static_cast<int>(state), std::memory_order_relaxed);
+    }
+
+    ResilienceSettings settings_;
+    std::mutex mutex_;
+    State state_ = State::Closed;
+    std::vector<Slot> slots_;
+    MetricsClock::time_point reopenAt_;
+    uint64_t probesInFlight_ = 0;
+    uint64_t probeSuccesses_ = 0;
+    std::atomic<int> stateValue_{0};
+    std::atomic<uint64_t> opened_{0};
+};
+
+// Chiave del limite: le credenziali non restano in memoria, solo il loro hash
+inline uint64_t rateLimitKey(std::string_view apiKey) {
+    return std::hash<std::string_view>{}(apiKey);
+}
+
+// Risposta per i messaggi che l'upstream non ha accettato nemmeno dopo una riconsegna
+inline std::string upstreamUnavailableReply(const std::string& upstream) {
+    return R"({"status":"error","message":"Servizio )" + upstream + R"( non disponibile, riprovare più tardi"})";
+}
+
+// Status consegnato al posto di una risposta quando il permesso non arriva
+// entro l'attesa massima: la richiesta non è partita (0 è un errore di rete)
+constexpr long kNotSentStatus = -1;
+
+// Permesso di chiamare l'upstream, da restituire a record con l'esito
+struct UpstreamPermit {
+    bool granted = false;
+    bool probe = false;
+};
+
+// Limiti e circuito di un upstream, condivisi da tutti gli event loop del processo
+class UpstreamGuard {
+public:
+    using PermitCallback = std::function<void(UpstreamPermit permit)>;
+
+    explicit UpstreamGuard(const std::string& upstream)
+        : settings_(resilienceSettings(upstream)), breaker_(settings_) {
+        std::string labels = "upstream=\"" + upstream + "\"";
+        auto admissions = [&labels](const char* result) {
+            return &metrics().counter("ow_upstream_admissions_total", "Chiamate upstream richieste per esito del limite e del circuito",
+                                      labels + ",result=\"" + result + "\"");
+        };
+        allowed_ = admissions("allowed");
+        rateLimited_ = admissions("rate_limited");
+        circuitOpen_ = admissions("circuit_open");
+        requeued_ = &metrics().counter("ow_upstream_requeued_total", "Messaggi rimessi in coda perché l'upstream non li accettava", labels);
+        probes_.push_back(metrics().probe("ow_circuit_state", "Stato del circuit breaker (0 chiuso, 1 semiaperto, 2 aperto)", "gauge", labels,
+            [this] { return static_cast<double>(breaker_.state()); }));
+        probes_.push_back(metrics().probe("ow_circuit_opened_total", "Aperture del circuit breaker", "counter", labels,
+            [this] { return static_cast<double>(breaker_.opened()); }));
+        probes_.push_back(metrics().probe("ow_rate_limiter_keys", "Chiavi API con un limite di richieste attivo", "gauge", labels,
+            [this] { return static_cast<double>(keyCount_.load(std::memory_order_relaxed)); }));
+    }
+
+    // Tentativo immediato: zero se la chiamata può partire, altrimenti l'attesa
+    // prima di riprovare (il circuito aperto ha la precedenza sul limite)
+    MetricsClock::duration tryAcquire(uint64_t key, UpstreamPermit& permit) {
+        auto now = MetricsClock::now();
+        permit = UpstreamPermit();
+        bool probe = false;
+        MetricsClock::duration wait = breaker_.admit(now, probe);
+        if (wait > MetricsClock::duration::zero()) {
+            circuitOpen_->add();
+            return wait;
+        }
+        wait = takeToken(key, now);
+        if (wait > MetricsClock::duration::zero()) {
+            // La prova non partita va restituita al circuito
+            if (probe) {
+                breaker_.releaseProbe();
+            }
+            rateLimited_->add();
+            return wait;
+        }
+        allowed_->add();
+        permit.granted = true;
+        permit.probe = probe;
+        return MetricsClock::duration::zero();
+    }
+
+    // Attende sull'io_context che l'upstream accetti la chiamata; se l'attesa
+    // supererebbe max_defer_ms onPermit riceve un permesso non concesso
+    void acquire(boost::asio::io_context& io_context, uint64_t key, PermitCallback onPermit) {
+        auto deferral = std::make_shared<Deferral>(io_context);
+        deferral->key = key;
+        deferral->giveUpAt = MetricsClock::now() + std::chrono::milliseconds(settings_.maxDeferMs);
+        deferral->onPermit = std::move(onPermit);
+        attempt(deferral);
+    }
+
+    // Esito della chiamata: status HTTP, 0 se la richiesta non è riuscita
+    void record(const UpstreamPermit& permit, uint64_t key, long status) {
+        if (!permit.granted) {
+            return;
+        }
+        auto now = MetricsClock::now();
+        breaker_.record(permit.probe, upstreamFailure(status), now);
+        if (status == 429 && settings_.ratePerSec > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = buckets_.find(key);
+            if (it != buckets_.end()) {
+                it->second.drain(now);
+            }
+        }
+    }
+
+    // Chiamata concessa ma annullata prima dell'esito: la prova torna al circuito
+    void abandon(const UpstreamPermit& permit) {
+        if (permit.granted && permit.probe) {
+            breaker_.releaseProbe();
+        }
+    }
+
+    // Messaggio restituito al broker dopo un'attesa inutile
+    void requeued() { requeued_->add(); }
+
+    const ResilienceSettings& settings() const { return settings_; }
+    CircuitBreaker::State state() const { return breaker_.state(); }
+
+private:
+    struct Deferral {
+        explicit Deferral(boost::asio::io_context& io_context) : timer(io_context) {}
+        boost::asio::steady_timer timer;
+        uint64_t key = 0;
+        MetricsClock::time_point giveUpAt;
+        PermitCallback onPermit;
+    };
+
+    void attempt(const std::shared_ptr<Deferral>& deferral) {
+        UpstreamPermit permit;
+        MetricsClock::duration wait = tryAcquire(deferral->key, permit);
+        if (permit.granted || MetricsClock::now() + wait > deferral->giveUpAt) {
+            deferral->onPermit(permit);
+            return;
+        }
+        deferral->timer.expires_after(wait);
+        deferral->timer.async_wait([this, deferral](const boost::system::error_code& ec) {
+            if (!ec) {
+                attempt(deferral);
+            }
+        });
+    }
+
+    MetricsClock::duration takeToken(uint64_t key, MetricsClock::time_point now) {
+        if (settings_.ratePerSec <= 0) {
+            return MetricsClock::duration::zero();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = buckets_.find(key);
+        if (it == buckets_.end()) {
+            // Troppe chiavi: si scartano i limiti inattivi (bucket pieno)
+            if (buckets_.size() >= settings_.maxKeys) {
+                for (auto idle = buckets_.begin(); idle != buckets_.end();) {
+                    idle = idle->second.idle(now) ? buckets_.erase(idle) : std::next(idle);
+                }
+            }
+            it = buckets_.emplace(key, TokenBucket(settings_.ratePerSec, settings_.burst, now)).first;
+            keyCount_.store(buckets_.size(), std::memory_order_relaxed);
+        }
+        return it->second.take(now);
+    }
+
+    ResilienceSettings settings_;
+    CircuitBreaker breaker_;
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, TokenBucket> buckets_;
+    std::atomic<size_t> keyCount_{0};
+    Counter* allowed_ = nullptr;
+    Counter* rateLimited_ = nullptr;
+    Counter* circuitOpen_ = nullptr;
+    Counter* requeued_ = nullptr;
+    std::vector<ProbeHandle> probes_;
+};
+
+inline UpstreamGuard& upstreamGuard(const std::string& upstream) {
+    return processSingleton<UpstreamGuard>(upstream);
+}
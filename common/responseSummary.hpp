@@ -0,0 +1,218 @@
+#pragma once
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "jsonFields.hpp"
+#include "jsonStream.hpp"
+#include "jsonWriter.hpp"
+
+// Risultato compatto delle risposte di vettori e gateway: mentre la risposta
+// arriva, il parser incrementale ne estrae solo i campi che servono ai consumer
+// (tariffe, valuta, servizio e giorni di transito; id e stato del pagamento) e
+// al posto del corpo dell'upstream viene pubblicato un JSON a schema fisso.
+// Il corpo originale si conserva solo se il messaggio lo chiede (campo "raw_response").
+
+// Un servizio quotato dal vettore
+struct SummaryOption {
+    std::string service;
+    double price = 0;
+    bool hasPrice = false;
+    std::string currency;
+    int transitDays = -1;     // -1 se il vettore non lo indica
+};
+
+// Link di una risposta di pagamento (PayPal: approval_url)
+struct SummaryLink {
+    std::string rel;
+    std::string href;
+};
+
+// Campi estratti da una risposta
+struct ResponseSummary {
+    std::vector<SummaryOption> options;
+    std::string paymentId;
+    std::string paymentStatus;
+    std::string paymentUrl;
+    std::vector<SummaryLink> links;
+
+    void clear() {
+        options.clear();
+        paymentId.clear();
+        paymentStatus.clear();
+        paymentUrl.clear();
+        links.clear();
+    }
+
+    // Elemento index degli array della risposta, aggiunto se manca
+    SummaryOption& option(size_t index) {
+        if (options.size() <= index) {
+            options.resize(index + 1);
+        }
+        return options[index];
+    }
+
+    SummaryLink& link(size_t index) {
+        if (links.size() <= index) {
+            links.resize(index + 1);
+        }
+        return links[index];
+    }
+};
+
+// Formato della risposta di un upstream: extract riceve gli eventi del parser,
+// render scrive il risultato (raw è vuoto se il corpo originale non è richiesto)
+// e restituisce false se nella risposta mancano i campi del risultato
+struct ResponseSchema {
+    const char* upstream;
+    void (*extract)(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary);
+    bool (*render)(std::string& out, const ResponseSchema& schema, const ResponseSummary& summary, std::string_view raw);
+};
+
+// Status con cui si consegna una risposta 2xx da cui non si ricava il risultato,
+// così l'errore pubblicato al suo posto non passa per un 200 (e non finisce
+// nella cache dei preventivi): 502 se il corpo non è JSON valido, 422 se
+// mancano i campi (nessuna tariffa, nessun id del pagamento)
+constexpr long kInvalidResponseStatus = 502;
+constexpr long kIncompleteResponseStatus = 422;
+
+// Campo facoltativo "raw_response" del messaggio: il risultato include il corpo originale
+inline bool rawResponseRequested(const JsonFields& fields) {
+    return fields.has("raw_response") && fields.boolean("raw_response");
+}
+
+// Numero che alcuni upstream restituiscono come stringa (es. UPS "38.90")
+inline bool summaryNumber(JsonToken token, std::string_view value, double& number) {
+    if (token != JsonToken::Number && token != JsonToken::String) {
+        return false;
+    }
+    auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+    return result.ec == std::errc() && result.ptr == value.data() + value.size();
+}
+
+inline void renderSummaryError(std::string& out, const char* message) {
+    JsonWriter json(out);
+    json.beginObject().field("status", "error").field("message", message).endObject();
+}
+
+// {"status":"ok","carrier":...,"options":[{"service","price","currency","transit_days"}]};
+// le opzioni senza prezzo vengono scartate
+inline bool renderQuoteSummary(std::string& out, const ResponseSchema& schema, const ResponseSummary& summary, std::string_view raw) {
+    bool priced = false;
+    for (const auto& option : summary.options) {
+        priced = priced || option.hasPrice;
+    }
+    if (!priced) {
+        renderSummaryError(out, "Nessuna tariffa nella risposta del vettore");
+        return false;
+    }
+
+    JsonWriter json(out);
+    json.beginObject()
+        .field("status", "ok")
+        .field("carrier", schema.upstream)
+        .key("options").beginArray();
+    for (const auto& option : summary.options) {
+        if (!option.hasPrice) {
+            continue;
+        }
+        json.beginObject()
+            .field("service", option.service)
+            .field("price", option.price)
+            .field("currency", option.currency);
+        if (option.transitDays >= 0) {
+            json.field("transit_days", option.transitDays);
+        }
+        json.endObject();
+    }
+    json.endArray();
+    if (!raw.empty()) {
+        json.key("raw").raw(raw);
+    }
+    json.endObject();
+    return true;
+}
+
+// {"status":"ok","gateway":...,"payment_id","payment_status","url"}; senza url
+// esplicito vale il link di approvazione (PayPal)
+inline bool renderPaymentSummary(std::string& out, const ResponseSchema& schema, const ResponseSummary& summary, std::string_view raw) {
+    if (summary.paymentId.empty()) {
+        renderSummaryError(out, "Identificativo del pagamento assente nella risposta");
+        return false;
+    }
+
+    std::string_view url = summary.paymentUrl;
+    for (const auto& link : summary.links) {
+        if (url.empty() && (link.rel == "approval_url" || link.rel == "approve")) {
+            url = link.href;
+        }
+    }
+
+    JsonWriter json(out);
+    json.beginObject()
+        .field("status", "ok")
+        .field("gateway", schema.upstream)
+        .field("payment_id", summary.paymentId)
+        .field("payment_status", summary.paymentStatus);
+    if (!url.empty()) {
+        json.field("url", url);
+    }
+    if (!raw.empty()) {
+        json.key("raw").raw(raw);
+    }
+    json.endObject();
+    return true;
+}
+
+// Estrazione incrementale di una risposta: feed a ogni pezzo, render alla fine.
+// Parser e campi conservano la capacità tra una risposta e l'altra
+class ResponseSummarizer {
+public:
+    void start(const ResponseSchema& schema) {
+        schema_ = &schema;
+        parser_.reset();
+        summary_.clear();
+    }
+
+    bool feed(const char* data, size_t size) {
+        Extract extract{*schema_, summary_};
+        return parser_.feed(data, size, extract);
+    }
+
+    // Scrive in out il risultato; raw è il corpo originale da allegare (o vuoto).
+    // Restituisce lo status da consegnare: quello della risposta se il risultato
+    // è valido, altrimenti kInvalidResponseStatus o kIncompleteResponseStatus
+    long render(std::string& out, std::string_view raw, long status) {
+        Extract extract{*schema_, summary_};
+        if (!parser_.ok() || !parser_.finish(extract)) {
+            renderSummaryError(out, "Risposta non valida dall'upstream");
+            return kInvalidResponseStatus;
+        }
+        return schema_->render(out, *schema_, summary_, raw) ? status : kIncompleteResponseStatus;
+    }
+
+private:
+    struct Extract {
+        const ResponseSchema& schema;
+        ResponseSummary& summary;
+        void operator()(const JsonPushParser& parser, JsonToken token, std::string_view value) {
+            schema.extract(parser, token, value, summary);
+        }
+    };
+
+    const ResponseSchema* schema_ = nullptr;
+    JsonPushParser parser_;
+    ResponseSummary summary_;
+};
+
+// Risultato di un corpo già completo (es. la parte di una risposta a più colli);
+// status diventa quello da consegnare con il risultato
+inline std::string summarizeBody(const ResponseSchema& schema, std::string_view body, bool includeRaw, long& status) {
+    ResponseSummarizer summarizer;
+    summarizer.start(schema);
+    summarizer.feed(body.data(), body.size());
+    std::string out;
+    status = summarizer.render(out, includeRaw ? body : std::string_view(), status);
+    return out;
+}
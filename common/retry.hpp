@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <amqpcpp.h>
+#include "config.hpp"
+#include "deadline.hpp"
+#include "metrics.hpp"
+#include "resilience.hpp"
+#include "routing.hpp"
+
+// Riprova dei messaggi lato broker. Un errore transitorio (upstream non
+// raggiungibile, 408, 429, 5xx, circuito aperto) ripubblica il messaggio in
+// una coda di attesa "<coda>.retry.<ms>" con TTL crescente (backoff
+// esponenziale) che, alla scadenza, lo riporta nella coda di input tramite
+// dead-lettering sull'exchange di default. Il TTL fa parte del nome: cambiando
+// i ritardi nella configurazione il worker dichiara code nuove invece di
+// ridichiarare quelle esistenti con argomenti diversi, che il broker
+// rifiuterebbe chiudendo il canale. Gli errori permanenti (messaggio
+// non valido) e i tentativi esauriti finiscono in "<coda>.dlq".
+// Il worker non aspetta mai: ripubblica, conferma e passa al messaggio
+// successivo; il tentativo viaggia nell'header x-retry-count.
+
+inline const std::string kRetryCountHeader = "x-retry-count";
+inline const std::string kFailureHeader = "x-failure";
+
+// Errori per cui un nuovo tentativo può riuscire
+inline bool transientFailure(long status) {
+    return upstreamFailure(status) || status == 408;
+}
+
+// Parametri dalla sezione "retry" della configurazione: la voce "default"
+// vale per tutte le code, la voce con il nome della coda la sovrascrive
+struct RetrySettings {
+    int maxAttempts = 0;          // ripubblicazioni prima della dead-letter (0 = nessuna)
+    long baseDelayMs = 500;       // attesa prima del primo nuovo tentativo
+    long maxDelayMs = 30000;      // tetto del backoff
+    double jitter = 0.2;          // frazione dell'attesa tolta a caso
+    bool deadLetter = true;       // coda <coda>.dlq per i messaggi scartati
+};
+
+inline RetrySettings retrySettings(const std::string& queue) {
+    RetrySettings settings;
+    const auto& sections = config().value("retry", nlohmann::json::object());
+
+    for (const char* key : {"default", queue.c_str()}) {
+        auto it = sections.find(key);
+        if (it == sections.end()) {
+            continue;
+        }
+        settings.maxAttempts = it->value("max_attempts", settings.maxAttempts);
+        settings.baseDelayMs = it->value("base_delay_ms", settings.baseDelayMs);
+        settings.maxDelayMs = it->value("max_delay_ms", settings.maxDelayMs);
+        settings.jitter = it->value("jitter", settings.jitter);
+        settings.deadLetter = it->value("dead_letter", settings.deadLetter);
+    }
+
+    settings.maxAttempts = std::clamp(settings.maxAttempts, 0, 16);
+    settings.baseDelayMs = std::max(1L, settings.baseDelayMs);
+    settings.maxDelayMs = std::max(settings.baseDelayMs, settings.maxDelayMs);
+    settings.jitter = std::clamp(settings.jitter, 0.0, 1.0);
+    return settings;
+}
+
+// Copia di un messaggio ricevuto, per poterlo ripubblicare dopo il callback
+// di consumo (quando il buffer del frame non è più valido)
+struct RetainedMessage {
+    std::string body;
+    AMQP::MetaData meta;
+
+    explicit RetainedMessage(const AMQP::Envelope& message) : body(message.body(), message.bodySize()) {
+        copyMetaData(message, meta);
+    }
+};
+
+// Tentativi già fatti: 0 alla prima consegna
+inline int retryAttempt(const AMQP::MetaData& message) {
+    if (message.hasHeaders() && message.headers().contains(kRetryCountHeader)) {
+        const AMQP::Field& header = message.headers().get(kRetryCountHeader);
+        if (header.isInteger()) {
+            return static_cast<int>(static_cast<int64_t>(header));
+        }
+    }
+    return 0;
+}
+
+// Code di attesa e dead-letter di una coda di input, per un canale (un event loop)
+class RetryQueues {
+public:
+    enum class Outcome {
+        Scheduled,   // ripubblicato in una coda di attesa
+        Exhausted,   // tentativi finiti: il chiamante risponde e lo manda in dead-letter
+        Expired      // la scadenza arriva prima del prossimo tentativo
+    };
+
+    RetryQueues(AMQP::Channel& channel, const std::string& queue, RetrySettings settings)
+        : channel_(channel), queue_(queue), settings_(settings), random_(std::random_device{}()),
+          deadLetters_(metrics().counter("ow_dead_letters_total", "Messaggi mandati nella coda di dead-letter",
+                                         "queue=\"" + queue + "\"")) {
+        std::string labels = "queue=\"" + queue + "\"";
+        for (int attempt = 1; attempt <= settings_.maxAttempts; attempt++) {
+            long delay = delayMs(attempt);
+            std::string name = queue_ + ".retry." + std::to_string(delay);
+            AMQP::Table arguments;
+            arguments.set("x-message-ttl", static_cast<int64_t>(delay));
+            arguments.set("x-dead-letter-exchange", "");
+            arguments.set("x-dead-letter-routing-key", queue_);
+            // Un errore qui chiude il canale: il consumo si ferma, va segnalato
+            channel_.declareQueue(name, arguments).onError([name](const char* message) {
+                std::cerr << "Dichiarazione della coda di attesa " << name << " fallita: " << message << std::endl;
+            });
+            levels_.push_back({std::move(name), delay,
+                &metrics().counter("ow_retries_total", "Messaggi ripubblicati per numero di tentativo",
+                                   labels + ",attempt=\"" + std::to_string(attempt) + "\"")});
+        }
+        if (settings_.deadLetter) {
+            channel_.declareQueue(deadLetterQueue());
+        }
+    }
+
+    RetryQueues(AMQP::Channel& channel, const std::string& queue) : RetryQueues(channel, queue, retrySettings(queue)) {}
+
+    RetryQueues(const RetryQueues&) = delete;
+    RetryQueues& operator=(const RetryQueues&) = delete;
+
+    // Con i nuovi tentativi il chiamante conserva una copia dei messaggi
+    bool enabled() const { return settings_.maxAttempts > 0; }
+
+    std::string deadLetterQueue() const { return queue_ + ".dlq"; }
+
+    // Ripubblica il messaggio nella coda di attesa del prossimo tentativo; il
+    // chiamante conferma il messaggio originale solo se l'esito è Scheduled
+    Outcome retry(const RetainedMessage& message, int64_t deadline) {
+        int attempt = retryAttempt(message.meta) + 1;
+        if (attempt > settings_.maxAttempts) {
+            return Outcome::Exhausted;
+        }
+        const Level& level = levels_[attempt - 1];
+        // Jitter: l'attesa scende fino a (1 - jitter) volte il TTL della coda,
+        // che resta il massimo (i messaggi scadono solo in testa alla coda)
+        long delay = level.delayMs - static_cast<long>(level.delayMs * settings_.jitter * unit_(random_));
+        if (deadline != 0 && epochMillis() + delay >= deadline) {
+            return Outcome::Expired;
+        }
+
+        AMQP::Envelope envelope(message.body.data(), message.body.size());
+        copyMetaData(message.meta, envelope, false);
+        AMQP::Table headers = message.meta.headers();
+        headers.set(kRetryCountHeader, static_cast<int64_t>(attempt));
+        if (deadline != 0) {
+            // L'expiration qui è l'attesa: la scadenza resta nell'header
+            headers.set(kDeadlineHeader, static_cast<int64_t>(deadline));
+        }
+        envelope.setHeaders(headers);
+        envelope.setExpiration(std::to_string(std::max(1L, delay)));
+        channel_.publish("", level.queue, envelope);
+        level.retries->add();
+        return Outcome::Scheduled;
+    }
+
+    // Messaggio scartato, con il motivo nell'header x-failure; false se la
+    // dead-letter è disattivata (nessuna publish)
+    bool deadLetter(const char* body, size_t size, const AMQP::MetaData& meta, const std::string& reason) {
+        if (!settings_.deadLetter) {
+            return false;
+        }
+        // Nella dead-letter il messaggio resta finché qualcuno non lo esamina: niente expiration
+        AMQP::Envelope envelope(body, size);
+        copyMetaData(meta, envelope, false);
+        AMQP::Table headers = meta.headers();
+        headers.set(kFailureHeader, reason);
+        envelope.setHeaders(headers);
+        channel_.publish("", deadLetterQueue(), envelope);
+        deadLetters_.add();
+        return true;
+    }
+
+    bool deadLetter(const RetainedMessage& message, const std::string& reason) {
+        return deadLetter(message.body.data(), message.body.size(), message.meta, reason);
+    }
+
+private:
+    struct Level {
+        std::string queue;
+        long delayMs;
+        Counter* retries;
+    };
+
+    long delayMs(int attempt) const {
+        long delay = settings_.baseDelayMs;
+        for (int i = 1; i < attempt && delay < settings_.maxDelayMs; i++) {
+            delay *= 2;
+        }
+        return std::min(delay, settings_.maxDelayMs);
+    }
+
+    AMQP::Channel& channel_;
+    std::string queue_;
+    RetrySettings settings_;
+    std::vector<Level> levels_;
+    std::minstd_rand random_;
+    std::uniform_real_distribution<double> unit_{0.0, 1.0};
+    Counter& deadLetters_;
+};
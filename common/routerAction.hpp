@@ -0,0 +1,113 @@
+#pragma once
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+#include "actionProxy.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
+#include "routingTable.hpp"
+
+// Router come azione OpenWhisk "conductor" (annotazione conductor=true): la
+// prima chiamata sceglie la destinazione con la stessa tabella del router
+// AMQP e restituisce {"action", "params", "state"}, così OpenWhisk invoca
+// l'azione del worker; la seconda riceve il risultato del worker, con lo
+// stato, e lo restituisce. Le azioni sono le code di destinazione, oppure i
+// nomi indicati in "actions" nella sezione del router. Le copie ("copies")
+// non si applicano: un conductor invoca una sola azione per passo.
+class RouterAction {
+public:
+    explicit RouterAction(std::string routerName)
+        : routerName_(std::move(routerName)),
+          path_(config().value("routes_file", std::string("routes.json"))),
+          table_(loadRoutingTable(path_, routerName_)),
+          lastWrite_(lastWriteTime()),
+          random_(std::random_device{}()),
+          routed_(messageCounter("ok")),
+          errors_(messageCounter("error")) {}
+
+    // Risultato dell'attivazione (un oggetto JSON)
+    std::string run(const ActionRun& run) {
+        reloadIfChanged();
+        auto params = nlohmann::json::parse(run.params, nullptr, false);
+        if (!params.is_object()) {
+            return fail("Parametri non validi");
+        }
+
+        // Ritorno dal worker: il suo risultato, senza lo stato del conductor
+        auto routed = params.find(kRoutedState);
+        if (routed != params.end()) {
+            params.erase(routed);
+            return params.dump();
+        }
+
+        auto field = params.find(table_->field());
+        if (field == params.end() || !field->is_string()) {
+            return fail("Il campo '" + table_->field() + "' non è specificato.");
+        }
+        std::string key = field->get<std::string>();
+        const Route* route = table_->find(key);
+        if (!route) {
+            return fail(table_->unknownError() + key);
+        }
+
+        const std::string& queue = chooseTarget(*table_, *route, random_);
+        routed_.add();
+        return nlohmann::json{{"action", table_->actionFor(queue)},
+                              {"params", std::move(params)},
+                              {"state", {{kRoutedState, true}}}}.dump();
+    }
+
+private:
+    // Parametro di stato che distingue il ritorno dal worker dalla richiesta
+    static constexpr const char* kRoutedState = "$routed";
+
+    std::string fail(const std::string& message) {
+        std::cerr << "Errore nel router " << routerName_ << ": " << message << std::endl;
+        errors_.add();
+        return nlohmann::json{{"error", message}}.dump();
+    }
+
+    std::filesystem::file_time_type lastWriteTime() const {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path_, ec);
+        return ec ? std::filesystem::file_time_type::min() : time;
+    }
+
+    // Nel container caldo la tabella resta caricata; si rilegge solo se il file cambia
+    void reloadIfChanged() {
+        auto writeTime = lastWriteTime();
+        if (writeTime == lastWrite_) {
+            return;
+        }
+        lastWrite_ = writeTime;
+        try {
+            table_ = loadRoutingTable(path_, routerName_);
+        } catch (const std::exception& e) {
+            std::cerr << "Router " << routerName_ << ": tabella non valida, ricaricamento ignorato: " << e.what() << std::endl;
+        }
+    }
+
+    std::string routerName_;
+    std::string path_;
+    std::shared_ptr<const RoutingTable> table_;
+    std::filesystem::file_time_type lastWrite_;
+    std::minstd_rand random_;
+    Counter& routed_;
+    Counter& errors_;
+};
+
+// main di un router in modalità azione: un solo event loop, nessuna connessione AMQP
+inline void runRouterAction(const std::string& routerName) {
+    boost::asio::io_context io_context;
+    RouterAction router(routerName);
+    ActionServer server(io_context, [&router](ActionRun run, ActionServer::Respond respond) {
+        respond(router.run(run));
+    });
+    server.start();
+    io_context.run();
+}
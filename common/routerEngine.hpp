@@ -0,0 +1,355 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <amqpcpp.h>
+#include <boost/asio.hpp>
+#include "config.hpp"
+#include "deadline.hpp"
+#include "metrics.hpp"
+#include "reply.hpp"
+#include "retry.hpp"
+#include "routing.hpp"
+#include "routingTable.hpp"
+
+// Motore di instradamento condiviso dai router: legge la tabella dal file
+// indicato da "routes_file" in configurazione (predefinito: routes.json) e la
+// ricarica quando il file cambia. La nuova tabella sostituisce la precedente
+// con uno scambio atomico tra due messaggi, senza perderne nessuno.
+// Le code di input e di output sono lette solo all'avvio.
+//
+// Il canale lavora in modalità publisher confirm: un messaggio in ingresso
+// viene confermato solo quando il broker ha accettato tutti i suoi inoltri
+// (consegna at-least-once). Gli ack verso il broker sono raccolti e inviati
+// una volta per giro dell'event loop, con un unico ack "multiple".
+//
+// Gli inoltri conservano correlation_id e reply_to. Se il messaggio ha un
+// reply_to la risposta è quella del worker, che la invia lì: il router non
+// pubblica la risposta di stato e solo gli errori di instradamento vanno al
+// reply_to. Le risposte del router portano il correlation_id della richiesta.
+//
+// La scadenza del messaggio (proprietà AMQP, vedi deadline.hpp, oppure
+// "default_timeout_ms" della tabella) viaggia con gli inoltri nell'header
+// x-deadline-ms; un messaggio già scaduto riceve subito la risposta di
+// errore senza essere inoltrato. "priority" della tabella (o della regola)
+// diventa la priorità AMQP degli inoltri che non ne hanno una.
+//
+// I messaggi che non si possono instradare (JSON non valido, discriminante
+// mancante o sconosciuto) ricevono la risposta di errore e vanno nella
+// dead-letter della coda di input; il router non fa nuovi tentativi.
+class RouterEngine {
+public:
+    RouterEngine(boost::asio::io_context& io_context, AMQP::Channel& channel, std::string routerName)
+        : io_context_(io_context),
+          channel_(channel),
+          routerName_(std::move(routerName)),
+          path_(config().value("routes_file", std::string("routes.json"))),
+          reloadInterval_(config().value("routes_reload_ms", 2000)),
+          timer_(io_context),
+          random_(std::random_device{}()),
+          parseLatency_(stageLatency("parse")),
+          publishLatency_(stageLatency("publish")),
+          confirmLatency_(stageLatency("confirm")),
+          routed_(messageCounter("ok")),
+          errors_(messageCounter("error")),
+          requeued_(messageCounter("requeued")),
+          expired_(messageCounter("expired")),
+          ackBatches_(metrics().counter("ow_router_ack_batches_total", "Ack multipli inviati dai router")) {
+        probes_.push_back(metrics().probe("ow_router_unconfirmed_messages", "Messaggi in attesa della conferma degli inoltri",
+            "gauge", "", [this] { return static_cast<double>(unconfirmedCount_.load(std::memory_order_relaxed)); }));
+    }
+
+    void start() {
+        auto table = loadRoutingTable(path_, routerName_);
+        lastWrite_ = lastWriteTime();
+        inputQueue_ = table->inputQueue();
+        statusQueue_ = table->outputQueue();
+
+        channel_.declareQueue(inputQueue_);
+        declareQueues(table);
+        RetrySettings retry = retrySettings(inputQueue_);
+        retry.maxAttempts = 0;
+        deadLetters_ = std::make_unique<RetryQueues>(channel_, inputQueue_, retry);
+        std::atomic_store(&table_, table);
+
+        // Finestra scorrevole: i messaggi con inoltri non ancora confermati
+        // restano senza ack, quindi il prefetch limita a max_in_flight gli
+        // inoltri in attesa di conferma senza copiare i body
+        QueueSettings settings = queueSettings(inputQueue_);
+        channel_.setQos(static_cast<uint16_t>(std::min<size_t>(settings.prefetch, settings.maxInFlight)));
+
+        channel_.confirmSelect()
+            .onAck([this](uint64_t publishTag, bool multiple) { onConfirm(publishTag, multiple, true); })
+            .onNack([this](uint64_t publishTag, bool multiple, bool) { onConfirm(publishTag, multiple, false); });
+
+        channel_.consume(inputQueue_).onReceived([this](const AMQP::Message& message, uint64_t deliveryTag, bool redelivered) {
+            onMessage(message, deliveryTag);
+        });
+
+        scheduleReload();
+    }
+
+    const std::string& inputQueue() const { return inputQueue_; }
+
+private:
+    // Stato di un messaggio in ingresso in attesa delle conferme dei suoi inoltri
+    struct PendingDelivery {
+        MetricsClock::time_point received;
+        size_t unconfirmed = 0;
+        bool failed = false;
+        std::string status;   // risposta pubblicata a conferma avvenuta (vuota: nessuna)
+        std::string correlationId;
+    };
+
+    void onMessage(const AMQP::Message& message, uint64_t deliveryTag) {
+        auto received = MetricsClock::now();
+        auto table = std::atomic_load(&table_);
+        unfinished_.insert(deliveryTag);
+        try {
+            // Solo le proprietà AMQP: il campo expires_at_ms del body lo leggono i worker
+            int64_t deadline = messageDeadline(message);
+            if (deadline == 0 && table->defaultTimeoutMs() > 0) {
+                deadline = epochMillis() + table->defaultTimeoutMs();
+            }
+            if (deadlineExpired(deadline)) {
+                publish(replyQueue(message, table->outputQueue()), expiredReply(), message.correlationID());
+                settled(deliveryTag);
+                expired_.add();
+                return;
+            }
+
+            // Il discriminante arriva da header, routing key o scansione del body:
+            // nessun DOM JSON viene costruito
+            std::string key = routingDiscriminator(message, table->field());
+            const Route* route = table->find(key);
+            if (!route) {
+                throw std::runtime_error(table->unknownError() + key);
+            }
+            parseLatency_.recordSince(received);
+
+            PendingDelivery& pending = deliveries_[deliveryTag];
+            pending.received = received;
+            pending.correlationId = message.correlationID();
+            {
+                StageTimer timer(publishLatency_);
+                forward(chooseTarget(*table, *route, random_), message, deliveryTag, pending, deadline, route->priority);
+                for (const auto& copy : route->copies) {
+                    forward(copy, message, deliveryTag, pending, deadline, route->priority);
+                }
+            }
+            unconfirmedCount_.store(deliveries_.size(), std::memory_order_relaxed);
+
+            // La risposta di stato parte solo quando gli inoltri sono confermati;
+            // con un reply_to risponde il worker
+            if (message.hasReplyTo()) {
+                pending.status.clear();
+            } else if (route->isDefault) {
+                pending.status = nlohmann::ordered_json{{"status", "success"}, {"route", "default"}, {table->field(), key}}.dump();
+            } else {
+                pending.status = route->response;
+            }
+
+        } catch (const std::exception& e) {
+            std::cerr << "Errore nel router " << routerName_ << ": " << e.what() << std::endl;
+
+            // Pubblica l'errore nella coda di output
+            std::string errorResponse = R"({"status":"error","message":")" + std::string(e.what()) + R"("})";
+            publish(replyQueue(message, table->outputQueue()), errorResponse, message.correlationID());
+            if (deadLetters_->deadLetter(message.body(), message.bodySize(), message, e.what())) {
+                ++publishSeq_;
+            }
+            deliveries_.erase(deliveryTag);
+            unconfirmedCount_.store(deliveries_.size(), std::memory_order_relaxed);
+            settled(deliveryTag);
+            errors_.add();
+        }
+    }
+
+    // Ogni publish sul canale consuma un numero di sequenza per le conferme
+    uint64_t publish(const std::string& queue, const std::string& body, const std::string& correlationId) {
+        publishReply(channel_, queue, body, correlationId);
+        return ++publishSeq_;
+    }
+
+    void forward(const std::string& queue, const AMQP::Message& message, uint64_t deliveryTag, PendingDelivery& pending,
+                 int64_t deadline, uint8_t priority) {
+        forwardMessage(channel_, queue, message, deadline, priority);
+        confirms_.emplace(++publishSeq_, deliveryTag);
+        pending.unconfirmed++;
+    }
+
+    void onConfirm(uint64_t publishTag, bool multiple, bool ack) {
+        auto begin = multiple ? confirms_.begin() : confirms_.find(publishTag);
+        auto end = confirms_.upper_bound(publishTag);
+        if (begin == confirms_.end() || begin->first > publishTag) {
+            // Conferma di una risposta di stato o di errore: nulla da fare
+            return;
+        }
+        if (!multiple) {
+            end = std::next(begin);
+        }
+        for (auto it = begin; it != end; ++it) {
+            confirmForward(it->second, ack);
+        }
+        confirms_.erase(begin, end);
+    }
+
+    void confirmForward(uint64_t deliveryTag, bool ack) {
+        auto it = deliveries_.find(deliveryTag);
+        if (it == deliveries_.end()) {
+            return;
+        }
+        PendingDelivery& pending = it->second;
+
+        if (!ack && !pending.failed) {
+            // Il broker ha rifiutato un inoltro: il messaggio torna in coda
+            // e verrà instradato di nuovo, senza risposta di stato
+            pending.failed = true;
+            channel_.reject(deliveryTag, AMQP::requeue);
+            unfinished_.erase(deliveryTag);
+            scheduleFlush();
+            requeued_.add();
+        }
+
+        if (--pending.unconfirmed == 0) {
+            if (!pending.failed) {
+                if (!pending.status.empty()) {
+                    publish(statusQueue_, pending.status, pending.correlationId);
+                }
+                settled(deliveryTag);
+                confirmLatency_.recordSince(pending.received);
+                routed_.add();
+            }
+            deliveries_.erase(it);
+            unconfirmedCount_.store(deliveries_.size(), std::memory_order_relaxed);
+        }
+    }
+
+    // Il messaggio può essere confermato al broker
+    void settled(uint64_t deliveryTag) {
+        unfinished_.erase(deliveryTag);
+        ready_.insert(deliveryTag);
+        scheduleFlush();
+    }
+
+    void scheduleFlush() {
+        if (flushScheduled_) {
+            return;
+        }
+        flushScheduled_ = true;
+        boost::asio::post(io_context_, [this] {
+            flushScheduled_ = false;
+            flushAcks();
+        });
+    }
+
+    // Un solo ack "multiple" copre tutti i messaggi pronti che precedono
+    // il più vecchio ancora in attesa di conferma
+    void flushAcks() {
+        auto limit = unfinished_.empty() ? ready_.end() : ready_.lower_bound(*unfinished_.begin());
+        if (limit == ready_.begin()) {
+            return;
+        }
+        channel_.ack(*std::prev(limit), AMQP::multiple);
+        ready_.erase(ready_.begin(), limit);
+        ackBatches_.add();
+    }
+
+    // Dichiara le code della tabella e ne legge il numero di consumer
+    void declareQueues(const std::shared_ptr<const RoutingTable>& table) {
+        channel_.declareQueue(table->outputQueue());
+        std::weak_ptr<const RoutingTable> weak = table;
+        for (size_t i = 0; i < table->queues().size(); i++) {
+            channel_.declareQueue(table->queues()[i]).onSuccess(
+                [weak, i](const std::string&, uint32_t, uint32_t consumers) {
+                    if (auto current = weak.lock()) {
+                        current->setConsumerCount(i, consumers);
+                    }
+                });
+        }
+    }
+
+    std::filesystem::file_time_type lastWriteTime() const {
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(path_, ec);
+        return ec ? std::filesystem::file_time_type::min() : time;
+    }
+
+    void scheduleReload() {
+        timer_.expires_after(std::chrono::milliseconds(reloadInterval_));
+        timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            reloadIfChanged();
+            scheduleReload();
+        });
+    }
+
+    void reloadIfChanged() {
+        auto current = std::atomic_load(&table_);
+        auto writeTime = lastWriteTime();
+        if (writeTime == lastWrite_) {
+            // Aggiorna solo lo stato dei consumer delle code di destinazione
+            declareQueues(current);
+            return;
+        }
+        lastWrite_ = writeTime;
+
+        try {
+            auto table = loadRoutingTable(path_, routerName_);
+            if (table->inputQueue() != inputQueue_) {
+                std::cerr << "Router " << routerName_ << ": il cambio della coda di input richiede un riavvio" << std::endl;
+            }
+            declareQueues(table);
+            std::atomic_store(&table_, table);
+            std::cout << "Router " << routerName_ << ": tabella di instradamento ricaricata da " << path_ << std::endl;
+        } catch (const std::exception& e) {
+            // La tabella precedente resta in uso
+            std::cerr << "Router " << routerName_ << ": tabella non valida, ricaricamento ignorato: " << e.what() << std::endl;
+        }
+    }
+
+    boost::asio::io_context& io_context_;
+    AMQP::Channel& channel_;
+    std::string routerName_;
+    std::string path_;
+    int reloadInterval_;
+    boost::asio::steady_timer timer_;
+    std::minstd_rand random_;
+    std::string inputQueue_;
+    std::filesystem::file_time_type lastWrite_;
+    std::shared_ptr<const RoutingTable> table_;
+    std::unique_ptr<RetryQueues> deadLetters_;    // solo la dead-letter, senza nuovi tentativi
+
+    uint64_t publishSeq_ = 0;
+    std::map<uint64_t, uint64_t> confirms_;                      // sequenza publish -> delivery tag
+    std::unordered_map<uint64_t, PendingDelivery> deliveries_;
+    std::set<uint64_t> unfinished_;                              // delivery tag senza esito
+    std::set<uint64_t> ready_;                                   // delivery tag da confermare
+    std::string statusQueue_;
+    bool flushScheduled_ = false;
+
+    // Fasi: parse = discriminante e regola, publish = inoltri,
+    // confirm = dalla ricezione alla conferma del broker
+    LatencyHistogram& parseLatency_;
+    LatencyHistogram& publishLatency_;
+    LatencyHistogram& confirmLatency_;
+    Counter& routed_;
+    Counter& errors_;
+    Counter& requeued_;
+    Counter& expired_;
+    Counter& ackBatches_;
+    std::atomic<size_t> unconfirmedCount_{0};
+    std::vector<ProbeHandle> probes_;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <amqpcpp.h>
+#include "deadline.hpp"
+#include "jsonScan.hpp"
+
+// Copia sul messaggio inoltrato le proprietà AMQP del messaggio originale
+// (senza expiration se il TTL non deve passare al nuovo messaggio)
+inline void copyMetaData(const AMQP::MetaData& from, AMQP::MetaData& to, bool expiration = true) {
+    if (from.hasContentType()) to.setContentType(from.contentType());
+    if (from.hasDeliveryMode()) to.setDeliveryMode(from.deliveryMode());
+    if (from.hasPriority()) to.setPriority(from.priority());
+    if (from.hasCorrelationID()) to.setCorrelationID(from.correlationID());
+    if (from.hasReplyTo()) to.setReplyTo(from.replyTo());
+    if (expiration && from.hasExpiration()) to.setExpiration(from.expiration());
+    if (from.hasMessageID()) to.setMessageID(from.messageID());
+    if (from.hasTimestamp()) to.setTimestamp(from.timestamp());
+    if (from.hasHeaders()) to.setHeaders(from.headers());
+}
+
+// Valore del campo di instradamento (es. "type" o "carrier"), in ordine di costo:
+//  1. header AMQP con lo stesso nome del campo
+//  2. ultimo segmento della routing key "<prefisso>.<valore>" (publish su exchange)
+//  3. scansione SAX del body, interrotta appena il campo è stato letto
+inline std::string routingDiscriminator(const AMQP::Message& message, const std::string& field) {
+    if (message.hasHeaders() && message.headers().contains(field)) {
+        const AMQP::Field& header = message.headers().get(field);
+        if (header.isString()) {
+            return static_cast<const std::string&>(header);
+        }
+    }
+
+    const std::string& routingKey = message.routingkey();
+    size_t dot = routingKey.rfind('.');
+    if (dot != std::string::npos && dot + 1 < routingKey.size()) {
+        return routingKey.substr(dot + 1);
+    }
+
+    std::string value;
+    switch (findTopLevelString(message.body(), message.bodySize(), field, value)) {
+        case JsonScanResult::Found:
+            return value;
+        case JsonScanResult::WrongType:
+            throw std::runtime_error("Il campo '" + field + "' non è una stringa.");
+        case JsonScanResult::Invalid:
+            throw std::runtime_error("Messaggio JSON non valido.");
+        case JsonScanResult::Missing:
+            break;
+    }
+    throw std::runtime_error("Il campo '" + field + "' non è specificato.");
+}
+
+// Inoltra il messaggio senza copiarne il body: l'envelope punta al buffer
+// del frame ricevuto, valido per tutta la durata del callback di consumo.
+// Scadenza (0 = nessuna) e priorità decise dal router vanno sull'inoltro; la
+// priorità AMQP del messaggio originale, se presente, resta quella
+inline void forwardMessage(AMQP::Channel& channel, const std::string& queue, const AMQP::Message& message,
+                           int64_t deadline = 0, uint8_t priority = 0) {
+    AMQP::Envelope envelope(message.body(), message.bodySize());
+    copyMetaData(message, envelope);
+    if (deadline != 0) {
+        setMessageDeadline(envelope, deadline);
+    }
+    if (priority != 0 && !message.hasPriority()) {
+        envelope.setPriority(priority);
+    }
+    channel.publish("", queue, envelope);
+}
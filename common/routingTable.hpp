@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Coda di destinazione con il suo peso nello split
+struct RouteTarget {
+    std::string queue;
+    uint32_t weight = 1;
+    size_t queueIndex = 0;   // posizione in RoutingTable::queues()
+};
+
+// Regola di instradamento per un valore del discriminante
+struct Route {
+    std::string key;
+    std::vector<RouteTarget> targets;   // split pesato: per ogni messaggio ne viene scelto uno
+    std::vector<std::string> copies;    // ricevono sempre una copia del messaggio
+    std::string fallback;               // usata se nessun target ha consumer attivi
+    std::string response;               // risposta di stato precalcolata
+    uint8_t priority = 0;               // priorità AMQP degli inoltri senza una propria
+    bool isDefault = false;
+};
+
+// Tabella di instradamento immutabile, caricata da file. La ricerca usa una
+// tabella hash piatta a indirizzamento aperto costruita al caricamento:
+// costo O(1) indipendente dal numero di regole.
+class RoutingTable {
+public:
+    // routerConfig è la sezione del file dedicata a un router
+    explicit RoutingTable(const nlohmann::json& routerConfig) {
+        field_ = routerConfig.at("field").get<std::string>();
+        inputQueue_ = routerConfig.at("input_queue").get<std::string>();
+        outputQueue_ = routerConfig.at("output_queue").get<std::string>();
+        responseField_ = routerConfig.value("response_field", field_);
+        unknownError_ = routerConfig.value("unknown_error", "Valore di '" + field_ + "' sconosciuto: ");
+        // Corsia dei messaggi del router (sovrascrivibile per regola) e scadenza
+        // assegnata ai messaggi che non ne hanno una (0 = nessuna)
+        priority_ = routerConfig.value("priority", uint8_t(0));
+        defaultTimeoutMs_ = routerConfig.value("default_timeout_ms", int64_t(0));
+        // Nome dell'azione OpenWhisk per coda, in modalità azione (predefinito: il nome della coda)
+        actions_ = routerConfig.value("actions", std::unordered_map<std::string, std::string>());
+
+        for (const auto& [key, rule] : routerConfig.at("routes").items()) {
+            routes_.push_back(parseRoute(key, rule));
+        }
+        if (routerConfig.contains("default") && !routerConfig["default"].is_null()) {
+            defaultRoute_ = std::make_unique<Route>(parseRoute("default", routerConfig["default"]));
+            defaultRoute_->isDefault = true;
+        }
+
+        buildIndex();
+        indexQueues();
+    }
+
+    const Route* find(std::string_view key) const {
+        size_t slot = hash(key) & mask_;
+        while (slots_[slot] >= 0) {
+            const Route& route = routes_[slots_[slot]];
+            if (route.key == key) {
+                return &route;
+            }
+            slot = (slot + 1) & mask_;
+        }
+        return defaultRoute_.get();
+    }
+
+    const std::string& field() const { return field_; }
+    const std::string& inputQueue() const { return inputQueue_; }
+    const std::string& outputQueue() const { return outputQueue_; }
+    const std::string& unknownError() const { return unknownError_; }
+    int64_t defaultTimeoutMs() const { return defaultTimeoutMs_; }
+
+    const std::string& actionFor(const std::string& queue) const {
+        auto it = actions_.find(queue);
+        return it == actions_.end() ? queue : it->second;
+    }
+
+    // Code di destinazione citate dalla tabella, senza duplicati
+    const std::vector<std::string>& queues() const { return queues_; }
+
+    // Numero di consumer della coda, aggiornato dal controllo periodico del router.
+    // Finché non è noto la coda è considerata disponibile
+    void setConsumerCount(size_t queueIndex, uint32_t consumers) const {
+        consumers_[queueIndex].store(consumers, std::memory_order_relaxed);
+    }
+
+    bool available(const RouteTarget& target) const {
+        return consumers_[target.queueIndex].load(std::memory_order_relaxed) != 0;
+    }
+
+private:
+    Route parseRoute(const std::string& key, const nlohmann::json& rule) const {
+        Route route;
+        route.key = key;
+        route.priority = priority_;
+
+        // Forma breve: "paypal": "paypalQueue"
+        if (rule.is_string()) {
+            route.targets.push_back({rule.get<std::string>(), 1});
+        } else {
+            for (const auto& target : rule.at("targets")) {
+                if (target.is_string()) {
+                    route.targets.push_back({target.get<std::string>(), 1});
+                } else {
+                    route.targets.push_back({target.at("queue").get<std::string>(), target.value("weight", 1u)});
+                }
+            }
+            route.copies = rule.value("copies", std::vector<std::string>());
+            route.fallback = rule.value("fallback", std::string());
+            route.priority = rule.value("priority", route.priority);
+        }
+
+        if (route.targets.empty()) {
+            throw std::runtime_error("Nessuna coda di destinazione per '" + key + "'");
+        }
+        route.response = nlohmann::ordered_json{{"status", "success"}, {responseField_, key}}.dump();
+        return route;
+    }
+
+    static uint64_t hash(std::string_view key) {
+        // FNV-1a
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    void buildIndex() {
+        size_t capacity = 8;
+        while (capacity < routes_.size() * 2) {
+            capacity <<= 1;
+        }
+        mask_ = capacity - 1;
+        slots_.assign(capacity, -1);
+
+        for (size_t i = 0; i < routes_.size(); i++) {
+            size_t slot = hash(routes_[i].key) & mask_;
+            while (slots_[slot] >= 0) {
+                slot = (slot + 1) & mask_;
+            }
+            slots_[slot] = static_cast<int32_t>(i);
+        }
+    }
+
+    void indexQueues() {
+        auto indexOf = [this](const std::string& queue) {
+            for (size_t i = 0; i < queues_.size(); i++) {
+                if (queues_[i] == queue) return i;
+            }
+            queues_.push_back(queue);
+            return queues_.size() - 1;
+        };
+        auto collect = [&indexOf](Route& route) {
+            for (auto& target : route.targets) target.queueIndex = indexOf(target.queue);
+            for (const auto& copy : route.copies) indexOf(copy);
+            if (!route.fallback.empty()) indexOf(route.fallback);
+        };
+        for (auto& route : routes_) collect(route);
+        if (defaultRoute_) collect(*defaultRoute_);
+
+        consumers_ = std::make_unique<std::atomic<int64_t>[]>(queues_.size());
+        for (size_t i = 0; i < queues_.size(); i++) {
+            consumers_[i].store(-1, std::memory_order_relaxed);
+        }
+    }
+
+    std::string field_;
+    std::string inputQueue_;
+    std::string outputQueue_;
+    std::string responseField_;
+    std::string unknownError_;
+    uint8_t priority_ = 0;
+    int64_t defaultTimeoutMs_ = 0;
+    std::unordered_map<std::string, std::string> actions_;
+    std::vector<Route> routes_;
+    std::unique_ptr<Route> defaultRoute_;
+    std::vector<int32_t> slots_;
+    size_t mask_ = 0;
+    std::vector<std::string> queues_;
+    std::unique_ptr<std::atomic<int64_t>[]> consumers_;
+};
+
+// Split pesato tra i target con consumer attivi; se non ce n'è nessuno
+// si usa la coda di fallback o, in mancanza, lo split su tutti i target
+template <typename Random>
+const std::string& chooseTarget(const RoutingTable& table, const Route& route, Random& random) {
+    if (route.targets.size() == 1 && (route.fallback.empty() || table.available(route.targets[0]))) {
+        return route.targets[0].queue;
+    }
+
+    uint64_t total = 0;
+    for (const auto& target : route.targets) {
+        if (table.available(target)) total += target.weight;
+    }
+    bool onlyAvailable = total > 0;
+    if (!onlyAvailable) {
+        if (!route.fallback.empty()) {
+            return route.fallback;
+        }
+        for (const auto& target : route.targets) total += target.weight;
+    }
+
+    uint64_t pick = std::uniform_int_distribution<uint64_t>(0, total - 1)(random);
+    for (const auto& target : route.targets) {
+        if (onlyAvailable && !table.available(target)) {
+            continue;
+        }
+        if (pick < target.weight) {
+            return target.queue;
+        }
+        pick -= target.weight;
+    }
+    return route.targets.back().queue;
+}
+
+// Carica la sezione del router dal file della tabella di instradamento
+inline std::shared_ptr<const RoutingTable> loadRoutingTable(const std::string& path, const std::string& routerName) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Tabella di instradamento non trovata: " + path);
+    }
+    auto document = nlohmann::json::parse(file);
+    if (!document.contains(routerName)) {
+        throw std::runtime_error("Router '" + routerName + "' non presente in " + path);
+    }
+    return std::make_shared<const RoutingTable>(document[routerName]);
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <amqpcpp.h>
+#include <boost/asio.hpp>
+#include "reply.hpp"
+
+// Esito di una chiamata: la risposta del worker (o del router, per un errore di
+// instradamento), oppure l'errore se non è arrivata entro il timeout
+struct RpcResponse {
+    std::string body;
+    std::string error;
+
+    bool ok() const { return error.empty(); }
+};
+
+using RpcCallback = std::function<void(RpcResponse)>;
+
+// Client request/reply su AMQP per le chiamate in stile sincrono (preventivi,
+// pagamenti): molte chiamate in corso sullo stesso canale, ognuna con il suo
+// correlation_id. Per default le risposte arrivano con direct reply-to, senza
+// una coda di risposta durevole; in alternativa si può indicare una coda
+// (esclusiva del client). Le risposte sconosciute o arrivate dopo il timeout
+// vengono scartate. Non è thread-safe: va usato dal thread dell'io_context del
+// canale.
+class RpcClient {
+public:
+    RpcClient(boost::asio::io_context& io_context, AMQP::Channel& channel, std::string replyQueue = kDirectReplyTo)
+        : channel_(channel), replyQueue_(std::move(replyQueue)), timer_(io_context) {
+        // Il prefisso distingue le risposte di questo client da quelle di altri
+        // client o di un'esecuzione precedente sulla stessa coda
+        std::random_device random;
+        prefix_ = std::to_string(random()) + std::to_string(random()) + ":";
+    }
+
+    RpcClient(const RpcClient&) = delete;
+    RpcClient& operator=(const RpcClient&) = delete;
+
+    ~RpcClient() { timer_.cancel(); }
+
+    // Consuma la coda delle risposte: va chiamato prima della prima call, sullo
+    // stesso canale (direct reply-to richiede consumer no-ack e publish sullo
+    // stesso canale)
+    void start() {
+        if (replyQueue_ != kDirectReplyTo) {
+            channel_.declareQueue(replyQueue_, AMQP::exclusive | AMQP::autodelete);
+        }
+        channel_.consume(replyQueue_, AMQP::noack).onReceived(
+            [this](const AMQP::Message& message, uint64_t, bool) { onReply(message); });
+    }
+
+    // Pubblica body sulla coda queue e chiama callback con la risposta, oppure
+    // con un errore allo scadere del timeout. Restituisce l'identificativo da
+    // passare a cancel
+    uint64_t call(const std::string& queue, std::string_view body, std::chrono::milliseconds timeout, RpcCallback callback) {
+        uint64_t id = ++lastId_;
+        std::string correlationId = prefix_ + std::to_string(id);
+        AMQP::Envelope envelope(body.data(), body.size());
+        envelope.setCorrelationID(correlationId);
+        envelope.setReplyTo(replyQueue_);
+        envelope.setContentType("application/json");
+        channel_.publish("", queue, envelope);
+
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        Call& call = calls_[id];
+        call.callback = std::move(callback);
+        call.deadline = deadlines_.emplace(deadline, id);
+        if (call.deadline == deadlines_.begin()) {
+            armTimer();
+        }
+        return id;
+    }
+
+    // Abbandona una chiamata: la risposta, se arriva, viene scartata
+    bool cancel(uint64_t id) {
+        auto it = calls_.find(id);
+        if (it == calls_.end()) {
+            return false;
+        }
+        deadlines_.erase(it->second.deadline);
+        calls_.erase(it);
+        return true;
+    }
+
+    // Chiamate in attesa di risposta
+    size_t pending() const { return calls_.size(); }
+
+    const std::string& replyQueue() const { return replyQueue_; }
+
+private:
+    using Deadlines = std::multimap<std::chrono::steady_clock::time_point, uint64_t>;
+
+    struct Call {
+        RpcCallback callback;
+        Deadlines::iterator deadline;
+    };
+
+    void onReply(const AMQP::Message& message) {
+        const std::string& correlationId = message.correlationID();
+        if (correlationId.compare(0, prefix_.size(), prefix_) != 0) {
+            return;
+        }
+        uint64_t id = std::strtoull(correlationId.c_str() + prefix_.size(), nullptr, 10);
+        auto it = calls_.find(id);
+        if (it == calls_.end()) {
+            return;
+        }
+        RpcCallback callback = std::move(it->second.callback);
+        deadlines_.erase(it->second.deadline);
+        calls_.erase(it);
+
+        RpcResponse response;
+        response.body.assign(message.body(), message.bodySize());
+        callback(std::move(response));
+    }
+
+    // Un solo timer, sulla scadenza più vicina
+    void armTimer() {
+        if (deadlines_.empty()) {
+            timer_.cancel();
+            return;
+        }
+        timer_.expires_at(deadlines_.begin()->first);
+        timer_.async_wait([this](const boost::system::error_code& ec) {
+            if (!ec) {
+                expire();
+            }
+        });
+    }
+
+    void expire() {
+        auto now = std::chrono::steady_clock::now();
+        while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+            uint64_t id = deadlines_.begin()->second;
+            deadlines_.erase(deadlines_.begin());
+            auto it = calls_.find(id);
+            if (it == calls_.end()) {
+                continue;
+            }
+            RpcCallback callback = std::move(it->second.callback);
+            calls_.erase(it);
+
+            RpcResponse response;
+            response.error = "Nessuna risposta entro il timeout";
+            callback(std::move(response));
+        }
+        armTimer();
+    }
+
+    AMQP::Channel& channel_;
+    std::string replyQueue_;
+    std::string prefix_;
+    boost::asio::steady_timer timer_;
+    uint64_t lastId_ = 0;
+    std::unordered_map<uint64_t, Call> calls_;
+    Deadlines deadlines_;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.hpp"
+#include "metrics.hpp"
+
+// Timeout e hedging delle chiamate verso un upstream, dalla sezione
+// "upstream_policies" della configurazione: la voce "default" vale per tutti,
+// la voce con il nome dell'upstream la sovrascrive
+struct UpstreamPolicy {
+    long connectTimeoutMs = 2000;
+    long minTimeoutMs = 1000;          // limiti del timeout adattivo
+    long maxTimeoutMs = 15000;         // usato anche finché mancano campioni
+    double timeoutPercentile = 0.99;
+    double timeoutMultiplier = 3.0;    // timeout = moltiplicatore x percentile
+    uint64_t minSamples = 50;          // campioni minimi per ricalcolare
+    bool hedge = false;                // seconda richiesta per le chiamate idempotenti lente
+    double hedgePercentile = 0.95;     // la seconda parte dopo questa latenza
+    long minHedgeDelayMs = 20;
+    double hedgeBudget = 0.05;         // al massimo una seconda richiesta ogni 20
+    size_t maxHedgesInFlight = 8;      // per event loop
+};
+
+inline UpstreamPolicy upstreamPolicy(const std::string& upstream) {
+    UpstreamPolicy policy;
+    const auto& policies = config().value("upstream_policies", nlohmann::json::object());
+
+    for (const char* key : {"default", upstream.c_str()}) {
+        auto it = policies.find(key);
+        if (it == policies.end()) {
+            continue;
+        }
+        policy.connectTimeoutMs = it->value("connect_timeout_ms", policy.connectTimeoutMs);
+        policy.minTimeoutMs = it->value("min_timeout_ms", policy.minTimeoutMs);
+        policy.maxTimeoutMs = it->value("max_timeout_ms", policy.maxTimeoutMs);
+        policy.timeoutPercentile = it->value("timeout_percentile", policy.timeoutPercentile);
+        policy.timeoutMultiplier = it->value("timeout_multiplier", policy.timeoutMultiplier);
+        policy.minSamples = it->value("min_samples", policy.minSamples);
+        policy.hedge = it->value("hedge", policy.hedge);
+        policy.hedgePercentile = it->value("hedge_percentile", policy.hedgePercentile);
+        policy.minHedgeDelayMs = it->value("min_hedge_delay_ms", policy.minHedgeDelayMs);
+        policy.hedgeBudget = it->value("hedge_budget", policy.hedgeBudget);
+        policy.maxHedgesInFlight = it->value("max_hedges_in_flight", policy.maxHedgesInFlight);
+    }
+
+    policy.minTimeoutMs = std::max(1L, policy.minTimeoutMs);
+    policy.maxTimeoutMs = std::max(policy.minTimeoutMs, policy.maxTimeoutMs);
+    return policy;
+}
+
+// Timeout e ritardo di hedging di un upstream, ricavati dalle latenze recenti
+// delle risposte riuscite (istogramma "total" di upstreamMetrics) e delle
+// richieste scadute. Queste ultime entrano come campioni censurati, pari al
+// tempo atteso: se la latenza supera il timeout corrente i campioni non
+// mancano e il timeout cresce fino a maxTimeoutMs, invece di restare fermo
+// mentre ogni richiesta scade. Il calcolo avviene al più una volta al secondo
+// per processo, su una finestra che si allarga finché contiene almeno
+// minSamples campioni; la lettura è lock-free.
+class AdaptiveLatency {
+public:
+    explicit AdaptiveLatency(const std::string& upstream)
+        : policy_(upstreamPolicy(upstream)), histogram_(upstreamMetrics(upstream).total),
+          previous_(LatencyHistogram::kBuckets, 0), previousTimedOut_(LatencyHistogram::kBuckets, 0), timeoutMs_(policy_.maxTimeoutMs) {
+        std::string labels = "upstream=\"" + upstream + "\"";
+        probes_.push_back(metrics().probe("ow_upstream_timeout_seconds", "Timeout adattivo delle chiamate upstream", "gauge", labels,
+            [this] { return timeoutMs_.load(std::memory_order_relaxed) / 1000.0; }));
+        probes_.push_back(metrics().probe("ow_upstream_hedge_delay_seconds", "Latenza dopo cui parte la seconda richiesta (0 = hedging inattivo)",
+            "gauge", labels, [this] { return hedgeDelayMs_.load(std::memory_order_relaxed) / 1000.0; }));
+    }
+
+    const UpstreamPolicy& policy() const { return policy_; }
+
+    long timeoutMs() {
+        refresh();
+        return timeoutMs_.load(std::memory_order_relaxed);
+    }
+
+    // 0 finché non ci sono abbastanza campioni o se l'hedging è disattivato
+    long hedgeDelayMs() {
+        refresh();
+        return hedgeDelayMs_.load(std::memory_order_relaxed);
+    }
+
+    // Richiesta scaduta dopo elapsedUs: la latenza vera è almeno questa
+    void recordTimeout(uint64_t elapsedUs) { timedOut_.record(elapsedUs); }
+
+private:
+    void refresh() {
+        int64_t now = MetricsClock::now().time_since_epoch().count();
+        if (now < nextRefresh_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            return;
+        }
+        nextRefresh_.store(now + std::chrono::duration_cast<MetricsClock::duration>(std::chrono::seconds(1)).count(),
+                           std::memory_order_relaxed);
+
+        LatencyHistogram::Snapshot current = histogram_.snapshot();
+        LatencyHistogram::Snapshot timedOut = timedOut_.snapshot();
+        LatencyHistogram::Snapshot window;
+        window.buckets.resize(current.buckets.size());
+        for (size_t i = 0; i < current.buckets.size(); i++) {
+            window.buckets[i] = current.buckets[i] - previous_[i] + timedOut.buckets[i] - previousTimedOut_[i];
+            window.count += window.buckets[i];
+        }
+        if (window.count < policy_.minSamples) {
+            return;
+        }
+        previous_ = std::move(current.buckets);
+        previousTimedOut_ = std::move(timedOut.buckets);
+
+        double timeoutUs = static_cast<double>(window.quantile(policy_.timeoutPercentile)) * policy_.timeoutMultiplier;
+        long timeoutMs = std::clamp(static_cast<long>(timeoutUs / 1000), policy_.minTimeoutMs, policy_.maxTimeoutMs);
+        timeoutMs_.store(timeoutMs, std::memory_order_relaxed);
+
+        if (policy_.hedge) {
+            long hedgeMs = static_cast<long>(window.quantile(policy_.hedgePercentile) / 1000);
+            // Una seconda richiesta che partisse dopo il timeout non servirebbe
+            hedgeMs = std::max(hedgeMs, policy_.minHedgeDelayMs);
+            hedgeDelayMs_.store(hedgeMs < timeoutMs ? hedgeMs : 0, std::memory_order_relaxed);
+        }
+    }
+
+    UpstreamPolicy policy_;
+    LatencyHistogram& histogram_;
+    std::mutex mutex_;
+    std::vector<uint64_t> previous_;
+    LatencyHistogram timedOut_;   // campioni censurati, fuori dalle metriche esportate
+    std::vector<uint64_t> previousTimedOut_;
+    std::atomic<int64_t> nextRefresh_{0};
+    std::atomic<long> timeoutMs_;
+    std::atomic<long> hedgeDelayMs_{0};
+    std::vector<ProbeHandle> probes_;
+};
+
+// Stato adattivo condiviso da tutti gli event loop del processo
+inline AdaptiveLatency& adaptiveLatency(const std::string& upstream) {
+    return processSingleton<AdaptiveLatency>(upstream);
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <amqpcpp.h>
+#include <amqpcpp/libboostasio.h>
+#include <boost/asio.hpp>
+#include "actionProxy.hpp"
+#include "config.hpp"
+#include "deadline.hpp"
+#include "eventLoops.hpp"
+#include "httpClient.hpp"
+#include "inFlightWindow.hpp"
+#include "jsonFields.hpp"
+#include "metrics.hpp"
+#include "reply.hpp"
+#include "resilience.hpp"
+#include "retry.hpp"
+
+// Runtime comune dei worker (gateway di pagamento e vettori): connessione AMQP,
+// code, prefetch e finestra dei messaggi, event loop per thread, client HTTP,
+// lettura dei campi del messaggio, risposte di errore, rimessa in coda e metriche
+// delle fasi. Un worker dichiara solo le code e un handler tipizzato:
+//
+//     struct Handler {
+//         using Request = ...;                       // dati del messaggio
+//         explicit Handler(WorkerLoop& loop);        // stato per event loop
+//         Request parse(JsonFields& fields, const AMQP::Envelope& message);
+//         void handle(Request request, WorkerReply reply);
+//     };
+//
+// parse legge il messaggio finché il buffer è valido (un'eccezione diventa una
+// risposta di errore); handle parte quando il messaggio entra nella finestra e
+// completa con una sola chiamata a reply, anche da un altro thread.
+// La risposta va al reply_to del messaggio, se c'è (vedi RpcClient), altrimenti
+// alla coda di output; il correlation_id della richiesta viene conservato.
+//
+// Scadenze (vedi deadline.hpp): un messaggio già scaduto all'arrivo o
+// all'ingresso nella finestra riceve subito una risposta di errore, senza
+// chiamare handle. Nella finestra parte prima la corsia a priorità più alta
+// (priorità AMQP del messaggio, altrimenti "priority" della coda), poi la
+// scadenza più vicina.
+//
+// Errori (vedi retry.hpp): un messaggio non valido va subito nella
+// dead-letter della coda di input, con la risposta di errore; con "retry"
+// configurato gli errori transitori dell'upstream (retryLater, sendOrRetry)
+// tornano nella coda dopo un'attesa crescente, e a tentativi esauriti il
+// messaggio riceve la risposta di errore e va nella dead-letter.
+//
+// Con OW_ACTION=1 lo stesso handler gira come azione OpenWhisk (vedi
+// actionProxy.hpp): i parametri di /run sono il body del messaggio, la
+// risposta torna come risultato dell'attivazione e la scadenza è quella
+// dell'attivazione; senza canale AMQP non ci sono nuovi tentativi né
+// dead-letter (le riprove sono di OpenWhisk).
+
+// Servizio (nome delle metriche) e code del worker
+struct WorkerSpec {
+    std::string service;
+    std::string inputQueue;
+    std::string outputQueue;
+};
+
+// Risorse di un event loop, create dal runtime e usate dagli handler
+class WorkerLoop {
+public:
+    // channel e retries sono nulli in modalità azione
+    WorkerLoop(boost::asio::io_context& io_context, AMQP::Channel* channel, AsyncHttpClient& http, RetryQueues* retries,
+               const WorkerSpec& spec)
+        : io_context_(io_context), channel_(channel), http_(http), retries_(retries), spec_(spec) {}
+
+    WorkerLoop(const WorkerLoop&) = delete;
+    WorkerLoop& operator=(const WorkerLoop&) = delete;
+
+    boost::asio::io_context& io() { return io_context_; }
+    AsyncHttpClient& http() { return http_; }
+    WorkerStages& stages() { return stages_; }
+    const WorkerSpec& spec() const { return spec_; }
+
+private:
+    friend class WorkerReply;
+
+    boost::asio::io_context& io_context_;
+    AMQP::Channel* channel_;
+    AsyncHttpClient& http_;
+    RetryQueues* retries_;
+    const WorkerSpec& spec_;
+    WorkerStages& stages_ = workerStages();
+};
+
+// Quanto serve del messaggio ricevuto per rispondere dopo il callback di consumo
+struct WorkerDelivery {
+    uint64_t deliveryTag = 0;
+    bool redelivered = false;
+    std::string correlationId;
+    std::string replyTo;        // vuoto: coda di output del servizio
+    int64_t deadline = 0;
+    MetricsClock::time_point received;
+    std::shared_ptr<const RetainedMessage> message;   // solo con i nuovi tentativi
+    std::function<void(std::string)> respond;          // modalità azione: risultato dell'attivazione
+};
+
+// Risposta a un messaggio non valido o a un'eccezione dell'handler
+inline std::string workerErrorReply(const std::string& error) {
+    return R"({"status":"error","message":")" + error + R"("})";
+}
+
+// Esito di un messaggio: pubblica la risposta e conferma il messaggio, oppure lo
+// rimette in coda. Va usato una sola volta; dagli altri thread l'esito passa
+// all'event loop del messaggio, l'unico che può usarne canale e finestra
+class WorkerReply {
+public:
+    WorkerReply(WorkerLoop& loop, WorkerDelivery delivery, InFlightWindow::Release release)
+        : loop_(&loop), delivery_(std::move(delivery)), started_(MetricsClock::now()), release_(std::move(release)) {}
+
+    bool redelivered() const { return delivery_.redelivered; }
+
+    // Risposta dell'upstream (o dalla cache) da pubblicare
+    void send(std::string body) const {
+        boost::asio::dispatch(loop_->io(), [reply = *this, body = std::move(body)] {
+            reply.loop_->stages().upstream.recordSince(reply.started_);
+            reply.publish(body);
+            reply.loop_->stages().ok.add();
+            reply.release_();
+        });
+    }
+
+    // Risposta dell'upstream con il suo status: se l'errore è transitorio il
+    // messaggio viene riprovato più tardi, altrimenti (o a tentativi esauriti)
+    // body viene pubblicato come con send
+    void sendOrRetry(long status, std::string body) const {
+        boost::asio::dispatch(loop_->io(), [reply = *this, status, body = std::move(body)] {
+            WorkerLoop& loop = *reply.loop_;
+            loop.stages().upstream.recordSince(reply.started_);
+            if (transientFailure(status) && reply.scheduleRetry()) {
+                loop.stages().errors.add();
+            } else {
+                reply.publish(body);
+                loop.stages().ok.add();
+            }
+            reply.release_();
+        });
+    }
+
+    // Upstream non disponibile (circuito aperto o limite superato): il messaggio
+    // viene riprovato più tardi e a tentativi esauriti riceve body. Senza
+    // "retry" configurato torna al broker alla prima consegna
+    void retryLater(std::string body, UpstreamGuard& guard) const {
+        boost::asio::dispatch(loop_->io(), [reply = *this, body = std::move(body), &guard] {
+            WorkerLoop& loop = *reply.loop_;
+            const WorkerDelivery& delivery = reply.delivery_;
+            if (!loop.channel_) {
+                reply.publish(body);
+            } else if (loop.retries_->enabled()) {
+                if (reply.scheduleRetry()) {
+                    guard.requeued();
+                } else {
+                    reply.publish(body);
+                }
+            } else if (requeueOrReply(*loop.channel_, delivery.deliveryTag, delivery.redelivered, reply.queue(), body,
+                                      delivery.correlationId)) {
+                guard.requeued();
+            }
+            loop.stages().errors.add();
+            reply.release_();
+        });
+    }
+
+    // Eccezione dall'handler: risposta di errore e conferma, come per un
+    // messaggio non valido, e dead-letter se il messaggio è stato conservato
+    void fail(const std::string& error) const {
+        boost::asio::dispatch(loop_->io(), [reply = *this, error] {
+            WorkerLoop& loop = *reply.loop_;
+            reply.publish(workerErrorReply(error));
+            if (loop.retries_ && reply.delivery_.message) {
+                loop.retries_->deadLetter(*reply.delivery_.message, error);
+            }
+            loop.stages().errors.add();
+            reply.release_();
+        });
+    }
+
+private:
+    const std::string& queue() const { return delivery_.replyTo.empty() ? loop_->spec().outputQueue : delivery_.replyTo; }
+
+    void publish(const std::string& body) const {
+        {
+            StageTimer timer(loop_->stages().publish);
+            if (delivery_.respond) {
+                delivery_.respond(body);
+            } else {
+                publishReply(*loop_->channel_, queue(), body, delivery_.correlationId);
+                loop_->channel_->ack(delivery_.deliveryTag);
+            }
+        }
+        loop_->stages().total.recordSince(delivery_.received);
+    }
+
+    // Ripubblica il messaggio nella coda di attesa e lo conferma; false se il
+    // messaggio va concluso qui (a tentativi esauriti è già nella dead-letter)
+    bool scheduleRetry() const {
+        RetryQueues* retries = loop_->retries_;
+        if (!retries || !retries->enabled() || !delivery_.message) {
+            return false;
+        }
+        switch (retries->retry(*delivery_.message, delivery_.deadline)) {
+            case RetryQueues::Outcome::Scheduled:
+                loop_->channel_->ack(delivery_.deliveryTag);
+                return true;
+            case RetryQueues::Outcome::Exhausted:
+                retries->deadLetter(*delivery_.message, "Tentativi esauriti");
+                return false;
+            case RetryQueues::Outcome::Expired:
+                return false;
+        }
+        return false;
+    }
+
+    WorkerLoop* loop_;
+    WorkerDelivery delivery_;
+    MetricsClock::time_point started_;
+    InFlightWindow::Release release_;
+};
+
+// Stato di un event loop del worker: finestra, code dei nuovi tentativi,
+// handler e lettura dei messaggi, dalla coda AMQP o dalle attivazioni
+template <typename Handler>
+class WorkerRuntime {
+public:
+    // channel è nullo in modalità azione
+    WorkerRuntime(boost::asio::io_context& io_context, AMQP::Channel* channel, AsyncHttpClient& http, const WorkerSpec& spec)
+        : spec_(spec),
+          settings_(queueSettings(spec.inputQueue)),
+          window_(settings_.maxInFlight, spec.inputQueue),
+          retries_(channel ? std::make_unique<RetryQueues>(*channel, spec.inputQueue) : nullptr),
+          channel_(channel),
+          loop_(io_context, channel, http, retries_.get(), spec),
+          stages_(loop_.stages()),
+          handler_(loop_) {}
+
+    WorkerRuntime(const WorkerRuntime&) = delete;
+    WorkerRuntime& operator=(const WorkerRuntime&) = delete;
+
+    const QueueSettings& settings() const { return settings_; }
+
+    // Un messaggio (o i parametri di un'attivazione): il buffer serve solo
+    // durante la chiamata
+    void receive(const AMQP::Envelope& message, WorkerDelivery delivery) {
+        try {
+            // Campi letti direttamente dal buffer del messaggio, senza copie
+            fields_.parse(message.body(), message.bodySize());
+
+            delivery.deadline = earliestDeadline(delivery.deadline, messageDeadline(message));
+            if (fields_.has(kDeadlineField)) {
+                delivery.deadline = earliestDeadline(delivery.deadline, static_cast<int64_t>(fields_.number(kDeadlineField)));
+            }
+            if (deadlineExpired(delivery.deadline)) {
+                finish(delivery, expiredReply());
+                stages_.expired.add();
+                return;
+            }
+
+            typename Handler::Request request = handler_.parse(fields_, message);
+            stages_.parse.recordSince(delivery.received);
+            // Copia per la ripubblicazione, fatta solo se i nuovi tentativi sono attivi
+            if (retries_ && retries_->enabled()) {
+                delivery.message = std::make_shared<const RetainedMessage>(message);
+            }
+
+            InFlightWindow::Schedule schedule{message.hasPriority() ? message.priority() : settings_.priority, delivery.deadline};
+            window_.submit([this, delivery = std::move(delivery), request = std::move(request)](InFlightWindow::Release release) mutable {
+                stages_.wait.recordSince(delivery.received);
+                // Scaduto mentre attendeva nella finestra
+                if (deadlineExpired(delivery.deadline)) {
+                    finish(delivery, expiredReply());
+                    stages_.expired.add();
+                    release();
+                    return;
+                }
+                // L'eccezione resta nel task: il messaggio riceve comunque una
+                // risposta e la conferma, e il posto nella finestra torna libero
+                WorkerReply reply(loop_, std::move(delivery), std::move(release));
+                try {
+                    handler_.handle(std::move(request), reply);
+                } catch (const std::exception& e) {
+                    std::cerr << "Errore nella gestione del messaggio: " << e.what() << std::endl;
+                    reply.fail(e.what());
+                }
+            }, schedule);
+
+        } catch (const std::exception& e) {
+            std::cerr << "Errore nella gestione del messaggio: " << e.what() << std::endl;
+            stages_.errors.add();
+
+            // Messaggio non valido: nessun nuovo tentativo, risposta di errore e dead-letter
+            finish(delivery, workerErrorReply(e.what()));
+            if (retries_) {
+                retries_->deadLetter(message.body(), message.bodySize(), message, e.what());
+            }
+        }
+    }
+
+private:
+    // Risposta senza passare dall'handler (scadenza o messaggio non valido)
+    void finish(const WorkerDelivery& delivery, const std::string& body) {
+        if (delivery.respond) {
+            delivery.respond(body);
+            return;
+        }
+        publishReply(*channel_, delivery.replyTo.empty() ? spec_.outputQueue : delivery.replyTo, body, delivery.correlationId);
+        channel_->ack(delivery.deliveryTag);
+    }
+
+    const WorkerSpec& spec_;
+    QueueSettings settings_;
+    InFlightWindow window_;
+    std::unique_ptr<RetryQueues> retries_;
+    AMQP::Channel* channel_;
+    WorkerLoop loop_;
+    WorkerStages& stages_;
+    Handler handler_;
+    JsonFields fields_;
+};
+
+// Un event loop del worker: connessione, canale e consumer propri
+template <typename Handler>
+void runWorkerLoop(const WorkerSpec& spec) {
+    boost::asio::io_context io_context;
+
+    AMQP::Address address(amqpAddress());
+    AMQP::LibBoostAsioHandler amqpHandler(io_context);
+    AMQP::TcpConnection connection(&amqpHandler, address);
+    AMQP::TcpChannel channel(&connection);
+    AsyncHttpClient http(io_context);
+
+    // Dichiarazione delle code
+    channel.declareQueue(spec.inputQueue);
+    channel.declareQueue(spec.outputQueue);
+
+    // Prefetch e finestra dei messaggi in elaborazione, configurabili per coda;
+    // il runtime dichiara anche le code di attesa e la dead-letter
+    WorkerRuntime<Handler> runtime(io_context, &channel, http, spec);
+    channel.setQos(runtime.settings().prefetch);
+
+    // Consuma i messaggi dalla coda di input
+    channel.consume(spec.inputQueue).onReceived([&](const AMQP::Message& message, uint64_t deliveryTag, bool redelivered) {
+        WorkerDelivery delivery;
+        delivery.received = MetricsClock::now();
+        delivery.deliveryTag = deliveryTag;
+        delivery.redelivered = redelivered;
+        delivery.correlationId = message.correlationID();
+        delivery.replyTo = message.replyTo();
+        runtime.receive(message, std::move(delivery));
+    });
+
+    std::cout << "In attesa di messaggi sulla coda " << spec.inputQueue << "..." << std::endl;
+    io_context.run();
+}
+
+// Il worker come azione OpenWhisk: un solo event loop, senza AMQP; runtime e
+// handler sono costruiti prima di accettare /init, così le attivazioni
+// trovano pronti pool di connessioni, token e cache
+template <typename Handler>
+void runWorkerAction(const WorkerSpec& spec) {
+    boost::asio::io_context io_context;
+    AsyncHttpClient http(io_context);
+    WorkerRuntime<Handler> runtime(io_context, nullptr, http, spec);
+
+    ActionServer server(io_context, [&runtime](ActionRun run, ActionServer::Respond respond) {
+        WorkerDelivery delivery;
+        delivery.received = MetricsClock::now();
+        delivery.deadline = run.deadline;
+        delivery.respond = std::move(respond);
+        runtime.receive(AMQP::Envelope(run.params.data(), run.params.size()), std::move(delivery));
+    });
+    server.start();
+    io_context.run();
+}
+
+// main di un worker: endpoint delle metriche e un event loop per thread,
+// oppure l'action proxy con OW_ACTION=1
+template <typename Handler>
+int runWorker(const WorkerSpec& spec) {
+    startMetricsServer(spec.service);
+    if (actionMode()) {
+        runWorkerAction<Handler>(spec);
+        return 0;
+    }
+    runEventLoops([&spec](size_t) { runWorkerLoop<Handler>(spec); });
+    return 0;
+}
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "../common/config.hpp"
+#include "../common/metrics.hpp"
+
+// Sezione "idempotency" della configurazione: directory dei log, dimensione
+// massima di ogni log e per quanto tempo un esito resta valido
+struct IdempotencySettings {
+    std::string directory = ".";
+    uint64_t maxLogBytes = 64ull << 20;
+    std::chrono::hours ttl{24};
+};
+
+inline IdempotencySettings idempotencySettings() {
+    IdempotencySettings settings;
+    const auto& section = config().value("idempotency", nlohmann::json::object());
+    settings.directory = section.value("directory", settings.directory);
+    settings.maxLogBytes = section.value("max_log_bytes", settings.maxLogBytes);
+    settings.ttl = std::chrono::hours(section.value("ttl_hours", static_cast<long>(settings.ttl.count())));
+    return settings;
+}
+
+// Chiave di un pagamento senza idempotency_key: hash del messaggio su 128 bit
+// (FNV-1a e std::hash), così due messaggi identici sono lo stesso pagamento
+inline std::string payloadIdempotencyKey(const char* data, size_t size) {
+    uint64_t fnv = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        fnv = (fnv ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+    }
+    uint64_t hash = std::hash<std::string_view>{}(std::string_view(data, size));
+    char key[40];
+    std::snprintf(key, sizeof(key), "p-%016llx%016llx", static_cast<unsigned long long>(fnv), static_cast<unsigned long long>(hash));
+    return key;
+}
+
+// Esiti definitivi, da restituire ai duplicati: successo o richiesta rifiutata.
+// Errori di rete, 409 (richiesta concorrente), 429 e 5xx si possono ritentare
+inline bool finalPaymentOutcome(long status) {
+    return status >= 200 && status < 500 && status != 409 && status != 429;
+}
+
+// Log append-only mappato in memoria degli esiti. Ogni record è
+// [dimensione][checksum][timestamp][lunghezza chiave][lunghezza esito][chiave][esito],
+// allineato a 8 byte; la dimensione si scrive per ultima, così un record
+// interrotto da un crash resta invisibile (o viene scartato dal checksum).
+// Più thread possono aggiungere record insieme; la compattazione è esclusiva.
+class IdempotencyLog {
+public:
+    struct Record {
+        std::string_view key;
+        std::string_view value;
+        int64_t timestampMs;
+    };
+
+    IdempotencyLog(std::string path, uint64_t capacity) : path_(std::move(path)), capacity_(capacity) {
+        map(path_);
+    }
+
+    // Scorre i record validi e posiziona la coda dopo l'ultimo
+    void replay(const std::function<void(const Record&)>& visit) {
+        uint64_t offset = kHeaderSize;
+        while (offset + kRecordHeader <= capacity_) {
+            const char* base = data() + offset;
+            uint32_t size = load<uint32_t>(base);
+            if (size == 0 || size < kRecordHeader || offset + size > capacity_) {
+                break;
+            }
+            uint32_t keyLength = load<uint32_t>(base + 16);
+            uint32_t valueLength = load<uint32_t>(base + 20);
+            if (kRecordHeader + static_cast<uint64_t>(keyLength) + valueLength > size ||
+                load<uint32_t>(base + 4) != checksum(base + 8, kRecordHeader - 8 + keyLength + valueLength)) {
+                break;
+            }
+            visit({std::string_view(base + kRecordHeader, keyLength),
+                   std::string_view(base + kRecordHeader + keyLength, valueLength), load<int64_t>(base + 8)});
+            offset += size;
+        }
+        tail_.store(offset);
+    }
+
+    // false se il log è pieno: va compattato
+    bool append(std::string_view key, std::string_view value, int64_t timestampMs) {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        uint64_t size = recordSize(key, value);
+        uint64_t offset = tail_.fetch_add(size);
+        if (offset + size > capacity_) {
+            return false;
+        }
+        write(data() + offset, key, value, timestampMs, size);
+        // Scrittura su disco in background: la pagina è già nella page cache
+        region_.flush(static_cast<size_t>(offset), static_cast<size_t>(size), true);
+        return true;
+    }
+
+    // Riscrive il log con i soli record forniti (quelli ancora validi): il nuovo
+    // file sostituisce il vecchio con un rename, quindi un crash lascia l'uno o l'altro
+    void compact(const std::vector<Record>& live) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        std::string next = path_ + ".compact";
+        std::filesystem::remove(next);
+        {
+            IdempotencyLog fresh(next, capacity_);
+            uint64_t offset = kHeaderSize;
+            for (const auto& record : live) {
+                uint64_t size = recordSize(record.key, record.value);
+                if (offset + size > capacity_) {
+                    break;
+                }
+                fresh.write(fresh.data() + offset, record.key, record.value, record.timestampMs, size);
+                offset += size;
+            }
+            fresh.region_.flush();
+        }
+        std::filesystem::rename(next, path_);
+        map(path_);
+        replay([](const Record&) {});
+    }
+
+    uint64_t size() const { return std::min(tail_.load(), capacity_); }
+    uint64_t capacity() const { return capacity_; }
+
+    static uint64_t recordSize(std::string_view key, std::string_view value) {
+        return (kRecordHeader + key.size() + value.size() + 7) & ~uint64_t(7);
+    }
+
+private:
+    static constexpr uint64_t kHeaderSize = 16;
+    static constexpr uint64_t kRecordHeader = 24;
+    static constexpr char kMagic[8] = {'O', 'W', 'I', 'D', 'E', 'M', 'P', '1'};
+
+    void map(const std::string& path) {
+        namespace fs = std::filesystem;
+        if (!fs::exists(path)) {
+            std::ofstream(path, std::ios::binary).put('\0');
+        }
+        if (fs::file_size(path) < capacity_) {
+            fs::resize_file(path, capacity_);
+        }
+        file_ = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_write);
+        region_ = boost::interprocess::mapped_region(file_, boost::interprocess::read_write, 0, static_cast<size_t>(capacity_));
+        if (std::memcmp(data(), kMagic, sizeof(kMagic)) != 0) {
+            // File nuovo o di un formato diverso: si riparte da un log vuoto
+            std::memset(data(), 0, static_cast<size_t>(capacity_));
+            std::memcpy(data(), kMagic, sizeof(kMagic));
+        }
+        tail_.store(kHeaderSize);
+    }
+
+    char* data() { return static_cast<char*>(region_.get_address()); }
+
+    static void write(char* base, std::string_view key, std::string_view value, int64_t timestampMs, uint64_t size) {
+        uint32_t keyLength = static_cast<uint32_t>(key.size());
+        uint32_t valueLength = static_cast<uint32_t>(value.size());
+        std::memcpy(base + 8, &timestampMs, 8);
+        std::memcpy(base + 16, &keyLength, 4);
+        std::memcpy(base + 20, &valueLength, 4);
+        std::memcpy(base + kRecordHeader, key.data(), key.size());
+        std::memcpy(base + kRecordHeader + key.size(), value.data(), value.size());
+        uint32_t sum = checksum(base + 8, kRecordHeader - 8 + key.size() + value.size());
+        std::memcpy(base + 4, &sum, 4);
+        // La dimensione rende visibile il record: va scritta dopo il resto
+        std::atomic_thread_fence(std::memory_order_release);
+        uint32_t recordBytes = static_cast<uint32_t>(size);
+        std::memcpy(base, &recordBytes, 4);
+    }
+
+    template <typename T>
+    static T load(const char* at) {
+        T value;
+        std::memcpy(&value, at, sizeof(T));
+        return value;
+    }
+
+    // FNV-1a a 32 bit: basta a riconoscere un record scritto a metà
+    static uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+        }
+        return hash;
+    }
+
+    std::string path_;
+    uint64_t capacity_;
+    std::shared_mutex mutex_;
+    boost::interprocess::file_mapping file_;
+    boost::interprocess::mapped_region region_;
+    std::atomic<uint64_t> tail_{kHeaderSize};
+};
+
+// Esiti dei pagamenti per chiave di idempotenza, condivisi da tutti gli event
+// loop del processo: tabella in memoria divisa in shard con lock indipendenti,
+// resa persistente dal log e ricaricata all'avvio. Una chiave è in corso
+// (il pagamento è partito) o completata (l'esito è nel log).
+class IdempotencyStore {
+public:
+    using ResultCallback = std::function<void(const std::string& response)>;
+
+    enum class Claim {
+        New,          // il chiamante esegue il pagamento, poi complete o release
+        Completed,    // esito già noto, consegnato subito a onDuplicate
+        InProgress    // stesso pagamento in corso: onDuplicate riceverà il suo esito
+    };
+
+    explicit IdempotencyStore(const std::string& service, size_t shardCount = 16)
+        : settings_(idempotencySettings()), shards_(shardCount),
+          log_((std::filesystem::path(settings_.directory) / ("idempotency-" + service + ".log")).string(), settings_.maxLogBytes) {
+        int64_t oldest = nowMs() - ttlMs();
+        log_.replay([this, oldest](const IdempotencyLog::Record& record) {
+            if (record.timestampMs >= oldest) {
+                Shard& shard = shardFor(record.key);
+                Entry& entry = shard.entries[std::string(record.key)];
+                entry.completed = true;
+                entry.response = std::string(record.value);
+                entry.timestampMs = record.timestampMs;
+            }
+        });
+
+        std::string labels = "service=\"" + service + "\"";
+        auto requests = [&labels](const char* result) {
+            return &metrics().counter("ow_idempotency_requests_total", "Pagamenti per esito della verifica di idempotenza",
+                                      labels + ",result=\"" + result + "\"");
+        };
+        newRequests_ = requests("new");
+        replayed_ = requests("replayed");
+        inProgress_ = requests("in_progress");
+        compactions_ = &metrics().counter("ow_idempotency_compactions_total", "Compattazioni del log di idempotenza", labels);
+        evicted_ = &metrics().counter("ow_idempotency_evicted_total", "Esiti non scaduti dimenticati perché il log era pieno", labels);
+        probes_.push_back(metrics().probe("ow_idempotency_log_bytes", "Byte occupati nel log di idempotenza", "gauge", labels,
+            [this] { return static_cast<double>(log_.size()); }));
+    }
+
+    IdempotencyStore(const IdempotencyStore&) = delete;
+    IdempotencyStore& operator=(const IdempotencyStore&) = delete;
+
+    // onDuplicate può essere chiamato da un altro thread (quello che completa il pagamento)
+    Claim claim(const std::string& key, ResultCallback onDuplicate) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.completed && it->second.timestampMs < nowMs() - ttlMs()) {
+            shard.entries.erase(it);
+            it = shard.entries.end();
+        }
+        if (it == shard.entries.end()) {
+            shard.entries[key];
+            lock.unlock();
+            newRequests_->add();
+            return Claim::New;
+        }
+        if (!it->second.completed) {
+            it->second.waiters.push_back(std::move(onDuplicate));
+            lock.unlock();
+            inProgress_->add();
+            return Claim::InProgress;
+        }
+        std::string response = it->second.response;
+        lock.unlock();
+        replayed_->add();
+        onDuplicate(response);
+        return Claim::Completed;
+    }
+
+    // Esito definitivo: resta valido per i duplicati, anche dopo un riavvio
+    void complete(const std::string& key, const std::string& response) {
+        int64_t timestampMs = nowMs();
+        // Prima la tabella, poi il log: una compattazione che parte tra le due
+        // scritture riscrive l'esito dalla tabella, mentre un record aggiunto
+        // al vecchio log e non ancora segnato completato andrebbe perso
+        finish(key, response, true, timestampMs);
+        if (!log_.append(key, response, timestampMs)) {
+            // Un solo thread compatta; gli altri trovano poi spazio nel log nuovo
+            std::lock_guard<std::mutex> compacting(compactMutex_);
+            if (!log_.append(key, response, timestampMs)) {
+                compact();
+                if (!log_.append(key, response, timestampMs)) {
+                    std::cerr << "Esito di " << key << " troppo grande per il log di idempotenza" << std::endl;
+                }
+            }
+        }
+    }
+
+    // Pagamento non riuscito in modo ritentabile: la chiave torna libera e i
+    // duplicati in attesa ricevono lo stesso esito
+    void release(const std::string& key, const std::string& response) {
+        finish(key, response, false, 0);
+    }
+
+private:
+    struct Entry {
+        bool completed = false;
+        std::string response;
+        int64_t timestampMs = 0;
+        std::vector<ResultCallback> waiters;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    static int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    int64_t ttlMs() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(settings_.ttl).count();
+    }
+
+    Shard& shardFor(std::string_view key) {
+        return shards_[std::hash<std::string_view>{}(key) % shards_.size()];
+    }
+
+    void finish(const std::string& key, const std::string& response, bool completed, int64_t timestampMs) {
+        Shard& shard = shardFor(key);
+        std::vector<ResultCallback> waiters;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(key);
+            if (it == shard.entries.end()) {
+                return;
+            }
+            waiters.swap(it->second.waiters);
+            if (completed) {
+                it->second.completed = true;
+                it->second.response = response;
+                it->second.timestampMs = timestampMs;
+            } else {
+                shard.entries.erase(it);
+            }
+        }
+        for (auto& waiter : waiters) {
+            waiter(response);
+        }
+    }
+
+    // Il log pieno viene riscritto con gli esiti non scaduti, dal più recente,
+    // fino a metà della capacità: se non bastasse, i più vecchi vengono
+    // dimenticati, così la compattazione successiva è lontana
+    void compact() {
+        int64_t oldest = nowMs() - ttlMs();
+        std::vector<std::pair<std::string, Entry>> live;
+        for (Shard& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+                if (it->second.completed && it->second.timestampMs < oldest) {
+                    it = shard.entries.erase(it);
+                    continue;
+                }
+                if (it->second.completed) {
+                    live.emplace_back(it->first, Entry{true, it->second.response, it->second.timestampMs, {}});
+                }
+                ++it;
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+            return a.second.timestampMs > b.second.timestampMs;
+        });
+
+        std::vector<IdempotencyLog::Record> records;
+        uint64_t bytes = 0;
+        size_t kept = 0;
+        for (; kept < live.size(); kept++) {
+            bytes += IdempotencyLog::recordSize(live[kept].first, live[kept].second.response);
+            if (bytes > log_.capacity() / 2) {
+                break;
+            }
+            records.push_back({live[kept].first, live[kept].second.response, live[kept].second.timestampMs});
+        }
+        log_.compact(records);
+        compactions_->add();
+
+        for (size_t i = kept; i < live.size(); i++) {
+            Shard& shard = shardFor(live[i].first);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(live[i].first);
+            if (it != shard.entries.end() && it->second.completed && it->second.timestampMs == live[i].second.timestampMs) {
+                shard.entries.erase(it);
+            }
+        }
+        if (kept < live.size()) {
+            evicted_->add(live.size() - kept);
+        }
+    }
+
+    IdempotencySettings settings_;
+    std::vector<Shard> shards_;
+    IdempotencyLog log_;
+    std::mutex compactMutex_;
+    Counter* newRequests_ = nullptr;
+    Counter* replayed_ = nullptr;
+    Counter* inProgress_ = nullptr;
+    Counter* compactions_ = nullptr;
+    Counter* evicted_ = nullptr;
+    std::vector<ProbeHandle> probes_;
+};
+
+// Un archivio per servizio, condiviso da tutti gli event loop del processo
+inline IdempotencyStore& idempotencyStore(const std::string& service) {
+    return processSingleton<IdempotencyStore>(service);
+}
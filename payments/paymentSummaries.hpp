@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string_view>
+#include "../common/jsonStream.hpp"
+#include "../common/responseSummary.hpp"
+
+// Campi dei pagamenti estratti dalle risposte dei gateway mentre arrivano
+
+// Stripe (sessione di checkout): id, payment_status (o status, se manca) e url
+// della pagina di pagamento
+inline void extractStripePayment(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary) {
+    if (token != JsonToken::String || parser.depth() != 1) {
+        return;
+    }
+    if (parser.matches({"id"})) {
+        summary.paymentId.assign(value);
+    } else if (parser.matches({"payment_status"})) {
+        summary.paymentStatus.assign(value);
+    } else if (parser.matches({"status"}) && summary.paymentStatus.empty()) {
+        summary.paymentStatus.assign(value);
+    } else if (parser.matches({"url"})) {
+        summary.paymentUrl.assign(value);
+    }
+}
+
+// PayPal (v1/payments/payment): id, state e links[i] con rel e href;
+// l'url è il link di approvazione
+inline void extractPaypalPayment(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary) {
+    if (token != JsonToken::String) {
+        return;
+    }
+    if (parser.matches({"id"})) {
+        summary.paymentId.assign(value);
+    } else if (parser.matches({"state"})) {
+        summary.paymentStatus.assign(value);
+    } else if (parser.matches({"links", "[]", "rel"})) {
+        summary.link(parser.index(1)).rel.assign(value);
+    } else if (parser.matches({"links", "[]", "href"})) {
+        summary.link(parser.index(1)).href.assign(value);
+    }
+}
+
+inline const ResponseSchema& stripePaymentSchema() {
+    static const ResponseSchema schema{"stripe", &extractStripePayment, &renderPaymentSummary};
+    return schema;
+}
+
+inline const ResponseSchema& paypalPaymentSchema() {
+    static const ResponseSchema schema{"paypal", &extractPaypalPayment, &renderPaymentSummary};
+    return schema;
+}
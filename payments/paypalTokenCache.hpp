@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include "../common/metrics.hpp"
+
+// Contatori della cache dei token, leggibili anche da altri thread
+struct TokenCacheStats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};   // richieste accodate a un fetch già in corso
+    std::atomic<uint64_t> refreshes{0};   // rinnovi proattivi in background
+    std::atomic<uint64_t> evictions{0};
+};
+
+// Cache in-process dei token OAuth PayPal, indicizzata per client_id.
+// Rispetta expires_in, rinnova il token in background prima della scadenza
+// (solo se è stato usato dall'ultimo rinnovo) e unisce le richieste
+// concorrenti per la stessa chiave in un'unica chiamata (single-flight).
+// Il numero di voci è limitato: oltre maxEntries si scarta la meno usata.
+class PaypalTokenCache {
+public:
+    using TokenCallback = std::function<void(std::string token)>;
+    using FetchCallback = std::function<void(std::string token, long expiresInSec)>;
+    using Fetcher = std::function<void(const std::string& clientId, const std::string& clientSecret, FetchCallback)>;
+
+    PaypalTokenCache(boost::asio::io_context& io_context, Fetcher fetcher, size_t maxEntries = 1024)
+        : io_context_(io_context), fetcher_(std::move(fetcher)), maxEntries_(maxEntries) {
+        auto probe = [this](const char* result, const std::atomic<uint64_t>& value) {
+            probes_.push_back(metrics().probe("ow_token_cache_requests_total", "Richieste alla cache dei token PayPal per esito",
+                "counter", std::string("result=\"") + result + "\"", [&value] { return static_cast<double>(value.load()); }));
+        };
+        probe("hit", stats_.hits);
+        probe("miss", stats_.misses);
+        probe("coalesced", stats_.coalesced);
+        probes_.push_back(metrics().probe("ow_token_cache_refreshes_total", "Rinnovi proattivi dei token PayPal",
+            "counter", "", [this] { return static_cast<double>(stats_.refreshes.load()); }));
+        probes_.push_back(metrics().probe("ow_token_cache_evictions_total", "Token PayPal scartati dalla cache",
+            "counter", "", [this] { return static_cast<double>(stats_.evictions.load()); }));
+    }
+
+    // Restituisce un token valido; stringa vuota se non è stato possibile ottenerlo
+    void get(const std::string& clientId, const std::string& clientSecret, TokenCallback onToken) {
+        auto it = entries_.find(clientId);
+        if (it != entries_.end() && it->second->clientSecret != clientSecret) {
+            // Credenziali cambiate: il token in cache non è più affidabile
+            erase(it);
+            it = entries_.end();
+        }
+
+        if (it != entries_.end()) {
+            Entry& entry = *it->second;
+            touch(entry);
+            if (!entry.token.empty() && Clock::now() < entry.expiresAt) {
+                stats_.hits++;
+                entry.usedSinceRefresh = true;
+                onToken(entry.token);
+                return;
+            }
+            if (entry.fetching) {
+                stats_.coalesced++;
+                entry.waiters.push_back(std::move(onToken));
+                return;
+            }
+        } else {
+            it = insert(clientId, clientSecret);
+        }
+
+        stats_.misses++;
+        Entry& entry = *it->second;
+        entry.waiters.push_back(std::move(onToken));
+        fetch(entry);
+    }
+
+    // Da chiamare quando l'upstream rifiuta il token (es. HTTP 401)
+    void invalidate(const std::string& clientId) {
+        auto it = entries_.find(clientId);
+        if (it != entries_.end() && !it->second->fetching) {
+            erase(it);
+        }
+    }
+
+    const TokenCacheStats& stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        explicit Entry(boost::asio::io_context& io_context) : refreshTimer(io_context) {}
+        std::string clientId;
+        std::string clientSecret;
+        std::string token;
+        Clock::time_point expiresAt;
+        bool fetching = false;
+        bool usedSinceRefresh = false;
+        std::vector<TokenCallback> waiters;
+        boost::asio::steady_timer refreshTimer;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    using EntryMap = std::unordered_map<std::string, std::shared_ptr<Entry>>;
+
+    EntryMap::iterator insert(const std::string& clientId, const std::string& clientSecret) {
+        while (entries_.size() >= maxEntries_ && !lru_.empty()) {
+            auto victim = entries_.find(lru_.back());
+            if (victim == entries_.end() || victim->second->fetching) {
+                break;
+            }
+            stats_.evictions++;
+            erase(victim);
+        }
+
+        auto entry = std::make_shared<Entry>(io_context_);
+        entry->clientId = clientId;
+        entry->clientSecret = clientSecret;
+        lru_.push_front(clientId);
+        entry->lruPosition = lru_.begin();
+        return entries_.emplace(clientId, std::move(entry)).first;
+    }
+
+    void erase(EntryMap::iterator it) {
+        // Chi era in attesa di un fetch ancora in corso riceve "token non disponibile"
+        for (auto& waiter : it->second->waiters) {
+            boost::asio::post(io_context_, [waiter = std::move(waiter)] { waiter(std::string()); });
+        }
+        it->second->waiters.clear();
+        it->second->refreshTimer.cancel();
+        lru_.erase(it->second->lruPosition);
+        entries_.erase(it);
+    }
+
+    void touch(Entry& entry) {
+        lru_.splice(lru_.begin(), lru_, entry.lruPosition);
+    }
+
+    void fetch(Entry& entry) {
+        entry.fetching = true;
+        entry.usedSinceRefresh = false;
+        std::weak_ptr<Entry> weak = entries_.at(entry.clientId);
+
+        fetcher_(entry.clientId, entry.clientSecret, [this, weak](std::string token, long expiresInSec) {
+            auto entry = weak.lock();
+            if (!entry) {
+                return;
+            }
+            entry->fetching = false;
+
+            if (!token.empty()) {
+                entry->token = std::move(token);
+                auto validity = std::chrono::seconds(expiresInSec);
+                entry->expiresAt = Clock::now() + validity - std::min(expirySafetyMargin, validity / 10);
+                scheduleRefresh(entry, expiresInSec);
+            } else if (Clock::now() >= entry->expiresAt) {
+                // Rinnovo fallito e token già scaduto: nessun valore da servire
+                entry->token.clear();
+            }
+
+            std::vector<TokenCallback> waiters;
+            waiters.swap(entry->waiters);
+            std::string current = Clock::now() < entry->expiresAt ? entry->token : std::string();
+            for (auto& waiter : waiters) {
+                waiter(current);
+            }
+
+            if (current.empty() && !entry->fetching) {
+                auto it = entries_.find(entry->clientId);
+                if (it != entries_.end() && it->second == entry) {
+                    erase(it);
+                }
+            }
+        });
+    }
+
+    // Rinnovo proattivo all'80% della validità, così i pagamenti non
+    // trovano mai il token scaduto
+    void scheduleRefresh(const std::shared_ptr<Entry>& entry, long expiresInSec) {
+        auto delay = std::chrono::seconds(std::max<long>(1, expiresInSec * 8 / 10));
+        std::weak_ptr<Entry> weak = entry;
+        entry->refreshTimer.expires_after(delay);
+        entry->refreshTimer.async_wait([this, weak](const boost::system::error_code& ec) {
+            auto entry = weak.lock();
+            if (ec || !entry || entry->fetching) {
+                return;
+            }
+            if (!entry->usedSinceRefresh) {
+                // Chiave inutilizzata: il token scade da solo senza altre chiamate
+                return;
+            }
+            stats_.refreshes++;
+            fetch(*entry);
+        });
+    }
+
+    static constexpr std::chrono::seconds expirySafetyMargin{30};
+
+    boost::asio::io_context& io_context_;
+    Fetcher fetcher_;
+    size_t maxEntries_;
+    EntryMap entries_;
+    std::list<std::string> lru_;
+    TokenCacheStats stats_;
+    std::vector<ProbeHandle> probes_;
+};
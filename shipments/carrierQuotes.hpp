@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include "../common/config.hpp"
+#include "../common/httpClient.hpp"
+#include "../common/metrics.hpp"
+#include "quoteBodies.hpp"
+
+// Richieste di preventivo ai vettori, condivise dai worker dei singoli vettori
+// e dal worker di confronto tariffe (functionBestRate)
+
+// Richiesta di preventivo DHL, costruita in una richiesta riciclata del client
+inline HttpRequest makeDhlQuoteRequest(
+    AsyncHttpClient& http,
+    std::string_view apiKey,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+
+    HttpRequest request = http.newRequest();
+    request.upstream = "dhl";
+    request.idempotent = true;   // un preventivo si può richiedere due volte
+    static const std::string url = upstreamBaseUrl("dhl", "https://api.dhl.com") + "/mydhlapi/shipments/v1/quotes";
+    request.url = url;
+
+    {
+        // Corpo della richiesta (JSON) dal template del vettore, nel buffer della richiesta
+        StageTimer timer(workerStages().build);
+        writeDhlQuoteBody(request.body, originCountry, destinationCountry, weight, length, width, height);
+    }
+
+    // Intestazioni HTTP
+    request.addHeader("Content-Type: application/json");
+    request.addHeader("Authorization: Bearer ", apiKey);
+    return request;
+}
+
+// Funzione per ottenere una stima delle tariffe di spedizione tramite DHL.
+// La richiesta è asincrona: onResponse riceve lo status HTTP (0 se la richiesta
+// non è partita) e il corpo della risposta (o l'errore). Restituisce
+// l'identificativo del trasferimento, per AsyncHttpClient::cancel
+inline uint64_t getDHLShippingQuote(
+    AsyncHttpClient& http,
+    HttpRequest request,
+    std::function<void(long, std::string)> onResponse) {
+
+    return http.perform(std::move(request), [onResponse = std::move(onResponse)](HttpResponse response) {
+        if (!response.ok()) {
+            std::cerr << "Errore CURL: " << response.error << std::endl;
+            onResponse(0, R"({"status":"error","message":"Errore nella richiesta HTTP"})");
+            return;
+        }
+
+        onResponse(response.status, std::move(response.body));
+    });
+}
+
+// Richiesta di preventivo FedEx, costruita in una richiesta riciclata del client
+inline HttpRequest makeFedExQuoteRequest(
+    AsyncHttpClient& http,
+    std::string_view accessKey,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+
+    HttpRequest request = http.newRequest();
+    request.upstream = "fedex";
+    request.idempotent = true;   // un preventivo si può richiedere due volte
+    static const std::string url = upstreamBaseUrl("fedex", "https://apis-sandbox.fedex.com") + "/rate/v1/rates/quotes";
+    request.url = url;
+
+    {
+        // Corpo della richiesta (JSON) dal template del vettore, nel buffer della richiesta
+        StageTimer timer(workerStages().build);
+        writeFedExQuoteBody(request.body, originCountry, destinationCountry, weight, length, width, height);
+    }
+
+    // Intestazioni HTTP
+    request.addHeader("Content-Type: application/json");
+    request.addHeader("Authorization: Bearer ", accessKey);
+    return request;
+}
+
+// Funzione per ottenere una stima delle tariffe di spedizione tramite FedEx.
+// La richiesta è asincrona: onResponse riceve lo status HTTP (0 se la richiesta
+// non è partita) e il corpo della risposta (o l'errore). Restituisce
+// l'identificativo del trasferimento, per AsyncHttpClient::cancel
+inline uint64_t getFedExShippingQuote(
+    AsyncHttpClient& http,
+    HttpRequest request,
+    std::function<void(long, std::string)> onResponse) {
+
+    return http.perform(std::move(request), [onResponse = std::move(onResponse)](HttpResponse response) {
+        if (!response.ok()) {
+            std::cerr << "Errore CURL: " << response.error << std::endl;
+            onResponse(0, R"({"status":"error","message":"Errore nella richiesta HTTP"})");
+            return;
+        }
+
+        onResponse(response.status, std::move(response.body));
+    });
+}
+
+// Richiesta di preventivo UPS, costruita in una richiesta riciclata del client
+inline HttpRequest makeUpsQuoteRequest(
+    AsyncHttpClient& http,
+    std::string_view accessKey,
+    std::string_view userId,
+    std::string_view password,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+
+    HttpRequest request = http.newRequest();
+    request.upstream = "ups";
+    request.idempotent = true;   // un preventivo si può richiedere due volte
+    static const std::string url = upstreamBaseUrl("ups", "https://onlinetools.ups.com") + "/rest/Rate";
+    request.url = url;
+
+    {
+        // Corpo della richiesta (JSON) dal template del vettore, nel buffer della richiesta
+        StageTimer timer(workerStages().build);
+        writeUpsQuoteBody(request.body, accessKey, userId, password, originCountry, destinationCountry,
+                          weight, length, width, height);
+    }
+
+    // Intestazioni HTTP
+    request.addHeader("Content-Type: application/json");
+    return request;
+}
+
+// Funzione per ottenere una stima delle tariffe di spedizione da UPS.
+// La richiesta è asincrona: onResponse riceve lo status HTTP (0 se la richiesta
+// non è partita) e il corpo della risposta (o l'errore). Restituisce
+// l'identificativo del trasferimento, per AsyncHttpClient::cancel
+inline uint64_t getUpsShippingQuote(
+    AsyncHttpClient& http,
+    HttpRequest request,
+    std::function<void(long, std::string)> onResponse) {
+
+    return http.perform(std::move(request), [onResponse = std::move(onResponse)](HttpResponse response) {
+        if (!response.ok()) {
+            std::cerr << "Errore CURL: " << response.error << std::endl;
+            onResponse(0, R"({"status":"error","message":"Errore nella richiesta HTTP"})");
+            return;
+        }
+
+        onResponse(response.status, std::move(response.body));
+    });
+}
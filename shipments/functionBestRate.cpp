@@ -0,0 +1,196 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio.hpp>
+#include "../common/httpClient.hpp"
+#include "../common/jsonFields.hpp"
+#include "../common/messageArena.hpp"
+#include "../common/metrics.hpp"
+#include "../common/resilience.hpp"
+#include "../common/worker.hpp"
+#include "carrierQuotes.hpp"
+#include "rateShopping.hpp"
+
+// Richiesta pronta per un vettore, inviata quando il messaggio entra nella finestra
+struct CarrierRequest {
+    std::string carrier;
+    HttpRequest request;
+    uint64_t (*send)(AsyncHttpClient&, HttpRequest, std::function<void(long, std::string)>);
+    uint64_t rateKey;   // chiave del limite di richieste del vettore
+};
+
+// Stato di un confronto in corso: preventivi raccolti, scadenza,
+// trasferimenti ancora aperti (0 = risposta già arrivata o richiesta non
+// partita), permessi ancora da registrare e arena per i DOM delle risposte e
+// la risposta pubblicata
+struct RateShopping {
+    explicit RateShopping(boost::asio::io_context& io_context) : deadline(io_context) {}
+
+    boost::asio::steady_timer deadline;
+    MessageArena arena;
+    std::vector<CarrierQuote> quotes;
+    std::vector<uint64_t> transfers;
+    std::vector<UpstreamPermit> permits;
+    std::vector<bool> outstanding;   // permesso concesso, esito non ancora registrato
+    size_t pending = 0;
+    bool finished = false;
+};
+
+// Confronto tariffe: bestRateShippingQueue -> bestRateShippingResponseQueue
+class BestRateHandler {
+public:
+    struct Request {
+        RateCriterion criterion;
+        std::chrono::milliseconds deadline;
+        std::vector<CarrierRequest> carriers;
+    };
+
+    explicit BestRateHandler(WorkerLoop& loop) : loop_(loop), shopping_(rateShoppingSettings()) {}
+
+    Request parse(JsonFields& fields, const AMQP::Envelope&) {
+        AsyncHttpClient& http = loop_.http();
+
+        // Spedizione da quotare
+        std::string_view originCountry = fields.string("origin_country");
+        std::string_view destinationCountry = fields.string("destination_country");
+        double weight = fields.number("weight");
+        double length = fields.number("length");
+        double width = fields.number("width");
+        double height = fields.number("height");
+
+        // Criterio e scadenza possono essere indicati nel messaggio
+        Request request{shopping_.criterion, shopping_.deadline, {}};
+        if (fields.has("criterion")) {
+            request.criterion = parseRateCriterion(std::string(fields.string("criterion")), request.criterion);
+        }
+        if (fields.has("deadline_ms")) {
+            request.deadline = std::chrono::milliseconds(static_cast<int64_t>(fields.number("deadline_ms")));
+        }
+
+        // Partecipano i vettori di cui il messaggio contiene le credenziali
+        if (fields.has("dhl_api_key")) {
+            request.carriers.push_back({"dhl", makeDhlQuoteRequest(http, fields.string("dhl_api_key"),
+                originCountry, destinationCountry, weight, length, width, height), &getDHLShippingQuote,
+                rateLimitKey(fields.string("dhl_api_key"))});
+        }
+        if (fields.has("fedex_access_key")) {
+            request.carriers.push_back({"fedex", makeFedExQuoteRequest(http, fields.string("fedex_access_key"),
+                originCountry, destinationCountry, weight, length, width, height), &getFedExShippingQuote,
+                rateLimitKey(fields.string("fedex_access_key"))});
+        }
+        if (fields.has("ups_access_key")) {
+            request.carriers.push_back({"ups", makeUpsQuoteRequest(http, fields.string("ups_access_key"),
+                fields.string("ups_user_id"), fields.string("ups_password"),
+                originCountry, destinationCountry, weight, length, width, height), &getUpsShippingQuote,
+                rateLimitKey(fields.string("ups_access_key"))});
+        }
+        if (request.carriers.empty()) {
+            throw std::runtime_error("Nessun vettore con credenziali nel messaggio");
+        }
+        return request;
+    }
+
+    void handle(Request request, WorkerReply reply) {
+        AsyncHttpClient& http = loop_.http();
+        auto started = MetricsClock::now();
+        auto state = std::make_shared<RateShopping>(loop_.io());
+        std::vector<CarrierRequest>& requests = request.carriers;
+
+        // Alla scadenza (o all'ultima risposta) vince il miglior preventivo arrivato;
+        // le richieste ancora in corso vengono annullate
+        auto finish = [&http, started, criterion = request.criterion, reply](const std::shared_ptr<RateShopping>& state) {
+            if (state->finished) {
+                return;
+            }
+            state->finished = true;
+            state->deadline.cancel();
+            // Anche una richiesta che non ha ottenuto un trasferimento (id 0) ha
+            // un permesso da restituire, altrimenti la sonda o il posto restano occupati
+            for (size_t i = 0; i < state->transfers.size(); i++) {
+                if (state->outstanding[i]) {
+                    if (state->transfers[i] != 0) {
+                        http.cancel(state->transfers[i]);
+                    }
+                    state->outstanding[i] = false;
+                    upstreamGuard(state->quotes[i].carrier).abandon(state->permits[i]);
+                    state->quotes[i].error = "Scadenza superata";
+                    state->quotes[i].latencyUs = elapsedMicros(started);
+                    rateShoppingCounter(state->quotes[i].carrier, "timeout").add();
+                }
+            }
+
+            {
+                ArenaScope scope(state->arena);
+                reply.send(bestRateReply(state->quotes, criterion));
+            }
+            // Dopo l'ack l'arena non serve più: i blocchi tornano al pool del thread
+            state->arena.reset();
+        };
+
+        state->quotes.resize(requests.size());
+        state->transfers.resize(requests.size());
+        state->permits.resize(requests.size());
+        state->outstanding.resize(requests.size());
+        state->pending = requests.size();
+
+        // Le richieste partono tutte insieme: la latenza è quella del vettore più lento
+        for (size_t i = 0; i < requests.size(); i++) {
+            std::string carrier = requests[i].carrier;
+            state->quotes[i].carrier = carrier;
+
+            // Un vettore con il circuito aperto o oltre il limite resta fuori dal
+            // confronto: attenderlo costerebbe più della scadenza
+            UpstreamGuard& guard = upstreamGuard(carrier);
+            if (guard.tryAcquire(requests[i].rateKey, state->permits[i]) > MetricsClock::duration::zero()) {
+                http.recycle(std::move(requests[i].request));
+                state->quotes[i].error = guard.state() == CircuitBreaker::State::Closed
+                    ? "Limite di richieste superato" : "Servizio non disponibile";
+                rateShoppingCounter(carrier, "unavailable").add();
+                state->pending--;
+                continue;
+            }
+
+            state->outstanding[i] = true;
+            uint64_t rateKey = requests[i].rateKey;
+            state->transfers[i] = requests[i].send(http, std::move(requests[i].request),
+                [state, i, carrier, &guard, rateKey, started, finish](long status, std::string response) {
+                    if (state->finished) {
+                        return;
+                    }
+                    guard.record(state->permits[i], rateKey, status);
+                    state->outstanding[i] = false;
+                    state->transfers[i] = 0;
+                    {
+                        ArenaScope scope(state->arena);
+                        state->quotes[i] = parseCarrierQuote(carrier, status, response);
+                    }
+                    state->quotes[i].latencyUs = elapsedMicros(started);
+                    rateShoppingCounter(carrier, state->quotes[i].ok ? "ok" : "error").add();
+                    if (--state->pending == 0) {
+                        finish(state);
+                    }
+                });
+        }
+
+        if (state->pending == 0) {
+            finish(state);
+            return;
+        }
+        state->deadline.expires_after(request.deadline);
+        state->deadline.async_wait([state, finish](const boost::system::error_code& ec) {
+            if (!ec) {
+                finish(state);
+            }
+        });
+    }
+
+private:
+    WorkerLoop& loop_;
+    const RateShoppingSettings& shopping_;
+};
+
+int main() {
+    return runWorker<BestRateHandler>({"best_rate", "bestRateShippingQueue", "bestRateShippingResponseQueue"});
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <boost/asio.hpp>
+#include <nlohmann/json.hpp>
+#include "../common/config.hpp"
+#include "../common/httpClient.hpp"
+#include "../common/messageArena.hpp"
+#include "../common/metrics.hpp"
+#include "quoteBodies.hpp"
+
+// Micro-batching dei preventivi FedEx e UPS: i preventivi per lo stesso account
+// e la stessa tratta che arrivano a pochi microsecondi l'uno dall'altro partono
+// in un'unica richiesta a più colli, e la risposta viene divisa per collo.
+// La tariffa di un collo in una spedizione a più colli può differire da quella
+// del collo spedito da solo: per questo il batching è opzionale.
+
+// Sezione "quote_batching" della configurazione, per vettore
+struct QuoteBatchSettings {
+    bool enabled = false;
+    size_t maxItems = 10;                         // colli per richiesta
+    std::chrono::microseconds maxDelay{2000};     // attesa massima del primo collo
+};
+
+inline QuoteBatchSettings quoteBatchSettings(const std::string& carrier) {
+    QuoteBatchSettings settings;
+    const auto& sections = config().value("quote_batching", nlohmann::json::object());
+    auto it = sections.find(carrier);
+    if (it != sections.end()) {
+        settings.enabled = it->value("enabled", settings.enabled);
+        settings.maxItems = std::max<size_t>(1, it->value("max_items", settings.maxItems));
+        settings.maxDelay = std::chrono::microseconds(it->value("max_delay_us", static_cast<int64_t>(settings.maxDelay.count())));
+    }
+    return settings;
+}
+
+// Campi comuni ai colli di un lotto, copiati dal primo messaggio
+struct QuoteShipment {
+    std::string accessKey;
+    std::string userId;
+    std::string password;
+    std::string originCountry;
+    std::string destinationCountry;
+};
+
+// Risposta FedEx per il collo index: totalNetCharge diventa il netCharge del
+// collo in ratedPackages. Vuota se la risposta non ha il dettaglio per collo
+inline std::string fedexPackageResponse(const ArenaJson& response, size_t index, size_t count) {
+    ArenaJson part = response;
+    bool split = false;
+    for (auto& detail : part.at("output").at("rateReplyDetails")) {
+        for (auto& rated : detail.at("ratedShipmentDetails")) {
+            const auto& packages = rated.at("ratedPackages");
+            if (packages.size() != count) {
+                return std::string();
+            }
+            ArenaJson package = packages.at(index);
+            rated["totalNetCharge"] = package.at("packageRateDetail").at("netCharge");
+            rated["ratedPackages"] = ArenaJson::array({std::move(package)});
+            split = true;
+        }
+    }
+    return split ? dumpJson(part) : std::string();
+}
+
+// Risposta UPS per il collo index: TotalCharges diventa quello del collo in RatedPackage
+inline std::string upsPackageResponse(const ArenaJson& response, size_t index, size_t count) {
+    ArenaJson part = response;
+    auto& rated = part.at("RateResponse").at("RatedShipment");
+    auto split = [index, count](ArenaJson& shipment) {
+        const auto& packages = shipment.at("RatedPackage");
+        if (!packages.is_array() || packages.size() != count) {
+            return false;
+        }
+        ArenaJson package = packages.at(index);
+        shipment["TotalCharges"] = package.at("TotalCharges");
+        shipment["RatedPackage"] = package;
+        return true;
+    };
+    if (rated.is_array()) {
+        if (rated.empty()) {
+            return std::string();
+        }
+        for (auto& shipment : rated) {
+            if (!split(shipment)) {
+                return std::string();
+            }
+        }
+    } else if (!split(rated)) {
+        return std::string();
+    }
+    return dumpJson(part);
+}
+
+// Formato del vettore: corpo a più colli e divisione della risposta
+struct QuoteBatchFormat {
+    void (*writeBody)(std::string& out, const QuoteShipment& shipment, const std::vector<QuotePackage>& packages);
+    std::string (*packageResponse)(const ArenaJson& response, size_t index, size_t count);
+};
+
+inline QuoteBatchFormat fedexBatchFormat() {
+    return {[](std::string& out, const QuoteShipment& shipment, const std::vector<QuotePackage>& packages) {
+                writeFedExBatchQuoteBody(out, shipment.originCountry, shipment.destinationCountry, packages);
+            },
+            &fedexPackageResponse};
+}
+
+inline QuoteBatchFormat upsBatchFormat() {
+    return {[](std::string& out, const QuoteShipment& shipment, const std::vector<QuotePackage>& packages) {
+                writeUpsBatchQuoteBody(out, shipment.accessKey, shipment.userId, shipment.password,
+                                       shipment.originCountry, shipment.destinationCountry, packages);
+            },
+            &upsPackageResponse};
+}
+
+// Raccoglie i colli per account e tratta fino a maxItems o maxDelay, poi invia
+// una sola richiesta. Ogni collo conserva la sua richiesta singola già pronta:
+// serve se il lotto ha un solo collo e se la risposta a più colli non si può
+// dividere o viene rifiutata (4xx), nel qual caso i colli partono uno per uno.
+// Non è thread-safe: un batcher per event loop.
+class QuoteBatcher {
+public:
+    using QuoteCallback = std::function<void(long status, std::string response)>;
+    // Invio di una richiesta con limiti e circuito dell'upstream; status
+    // kNotSentStatus se la richiesta non è partita
+    using Send = std::function<void(HttpRequest request, uint64_t rateKey, QuoteCallback onResponse)>;
+
+    QuoteBatcher(boost::asio::io_context& io_context, AsyncHttpClient& http, const std::string& carrier,
+                 QuoteBatchFormat format, Send send)
+        : io_context_(io_context), http_(http), settings_(quoteBatchSettings(carrier)),
+          format_(format), send_(std::move(send)) {
+        std::string labels = "carrier=\"" + carrier + "\"";
+        auto batches = [&labels](const char* result) {
+            return &metrics().counter("ow_quote_batches_total", "Richieste di preventivo a più colli per esito",
+                                      labels + ",result=\"" + result + "\"");
+        };
+        split_ = batches("ok");
+        fallback_ = batches("fallback");
+        failed_ = batches("error");
+        packages_ = &metrics().counter("ow_quote_batched_packages_total", "Colli quotati in richieste a più colli", labels);
+    }
+
+    QuoteBatcher(const QuoteBatcher&) = delete;
+    QuoteBatcher& operator=(const QuoteBatcher&) = delete;
+
+    bool enabled() const { return settings_.enabled; }
+
+    void add(const QuoteShipment& shipment, uint64_t rateKey, QuotePackage package, HttpRequest single, QuoteCallback onResponse) {
+        if (!settings_.enabled) {
+            send_(std::move(single), rateKey, std::move(onResponse));
+            return;
+        }
+
+        std::string key;
+        key.append(shipment.accessKey).append("|").append(shipment.userId).append("|").append(shipment.password).append("|")
+           .append(shipment.originCountry).append("|").append(shipment.destinationCountry);
+        auto it = batches_.find(key);
+        if (it == batches_.end()) {
+            auto batch = std::make_shared<Batch>(io_context_);
+            batch->id = ++lastBatchId_;
+            batch->shipment = shipment;
+            batch->rateKey = rateKey;
+            batch->timer.expires_after(settings_.maxDelay);
+            batch->timer.async_wait([this, key, id = batch->id](const boost::system::error_code& ec) {
+                auto found = batches_.find(key);
+                if (!ec && found != batches_.end() && found->second->id == id) {
+                    flush(found);
+                }
+            });
+            it = batches_.emplace(std::move(key), std::move(batch)).first;
+        }
+
+        Batch& batch = *it->second;
+        batch.packages.push_back(package);
+        batch.singles.push_back(std::move(single));
+        batch.callbacks.push_back(std::move(onResponse));
+        if (batch.packages.size() >= settings_.maxItems) {
+            flush(it);
+        }
+    }
+
+private:
+    struct Batch {
+        explicit Batch(boost::asio::io_context& io_context) : timer(io_context) {}
+        uint64_t id = 0;
+        boost::asio::steady_timer timer;
+        QuoteShipment shipment;
+        uint64_t rateKey = 0;
+        std::vector<QuotePackage> packages;
+        std::vector<HttpRequest> singles;
+        std::vector<QuoteCallback> callbacks;
+    };
+
+    using BatchMap = std::unordered_map<std::string, std::shared_ptr<Batch>>;
+
+    void flush(BatchMap::iterator it) {
+        std::shared_ptr<Batch> batch = std::move(it->second);
+        batches_.erase(it);
+        batch->timer.cancel();
+
+        if (batch->packages.size() == 1) {
+            send_(std::move(batch->singles.front()), batch->rateKey, std::move(batch->callbacks.front()));
+            return;
+        }
+
+        // Url e intestazioni sono quelle della richiesta singola
+        const HttpRequest& single = batch->singles.front();
+        HttpRequest request = http_.newRequest();
+        request.url = single.url;
+        request.headers = single.headers;
+        request.upstream = single.upstream;
+        request.idempotent = single.idempotent;
+        {
+            StageTimer timer(workerStages().build);
+            format_.writeBody(request.body, batch->shipment, batch->packages);
+        }
+        packages_->add(batch->packages.size());
+
+        send_(std::move(request), batch->rateKey, [this, batch](long status, std::string response) {
+            complete(*batch, status, response);
+        });
+    }
+
+    void complete(Batch& batch, long status, const std::string& response) {
+        size_t count = batch.packages.size();
+        if (status == 200) {
+            std::vector<std::string> parts;
+            try {
+                // Il DOM e le sue copie per collo stanno nell'arena del batcher,
+                // svuotata a ogni risposta
+                ArenaScope scope(arena_);
+                auto parsed = ArenaJson::parse(response);
+                for (size_t i = 0; i < count; i++) {
+                    parts.push_back(format_.packageResponse(parsed, i, count));
+                    if (parts.back().empty()) {
+                        break;
+                    }
+                }
+            } catch (const std::exception&) {
+                parts.clear();
+            }
+            arena_.reset();
+            if (parts.size() == count && !parts.back().empty()) {
+                split_->add();
+                for (size_t i = 0; i < count; i++) {
+                    // La richiesta a più colli non ha schema: ogni parte si
+                    // riassume come la risposta della sua richiesta singola
+                    const HttpRequest& single = batch.singles[i];
+                    long partStatus = 200;
+                    if (single.schema) {
+                        parts[i] = summarizeBody(*single.schema, parts[i], single.includeRaw, partStatus);
+                    }
+                    http_.recycle(std::move(batch.singles[i]));
+                    batch.callbacks[i](partStatus, std::move(parts[i]));
+                }
+                return;
+            }
+        }
+
+        // Risposta senza dettaglio per collo o lotto rifiutato: i colli partono uno per uno
+        if (status == 200 || (status >= 400 && status < 500 && status != 429)) {
+            fallback_->add();
+            for (size_t i = 0; i < count; i++) {
+                send_(std::move(batch.singles[i]), batch.rateKey, std::move(batch.callbacks[i]));
+            }
+            return;
+        }
+
+        // Upstream non raggiungibile o in difficoltà: lo stesso esito vale per tutti i colli
+        failed_->add();
+        for (size_t i = 0; i < count; i++) {
+            http_.recycle(std::move(batch.singles[i]));
+            batch.callbacks[i](status, response);
+        }
+    }
+
+    boost::asio::io_context& io_context_;
+    AsyncHttpClient& http_;
+    QuoteBatchSettings settings_;
+    QuoteBatchFormat format_;
+    Send send_;
+    BatchMap batches_;
+    MessageArena arena_;
+    uint64_t lastBatchId_ = 0;
+    Counter* split_ = nullptr;
+    Counter* fallback_ = nullptr;
+    Counter* failed_ = nullptr;
+    Counter* packages_ = nullptr;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../common/bodyTemplate.hpp"
+#include "../common/jsonWriter.hpp"
+
+// Corpi delle richieste di preventivo dei vettori. La forma è fissa e cambiano
+// solo paesi e misure del collo, quindi ogni corpo è descritto una volta come
+// template constexpr. Le chiavi sono in ordine alfabetico: l'output è identico
+// byte per byte al dump() del nlohmann::json costruito in precedenza.
+
+namespace quotebodies {
+
+using namespace bodytpl;
+
+// Argomenti: originCountry, destinationCountry, weight, length, width, height
+constexpr auto dhl = bodyTemplate(
+    text(R"({"destination":{"country":)"), string<1>(),
+    text(R"(},"dimensions":{"height":)"), number<5>(),
+    text(R"(,"length":)"), number<3>(),
+    text(R"(,"width":)"), number<4>(),
+    text(R"(},"origin":{"country":)"), string<0>(),
+    text(R"(},"weight":)"), number<2>(),
+    text("}"));
+
+// Argomenti: originCountry, destinationCountry, weight, length, width, height
+constexpr auto fedex = bodyTemplate(
+    text(R"({"requestedShipment":{"packageCount":1,"recipient":{"address":{"countryCode":)"), string<1>(),
+    text(R"(}},"requestedPackageLineItems":[{"dimensions":{"height":)"), number<5>(),
+    text(R"(,"length":)"), number<3>(),
+    text(R"(,"width":)"), number<4>(),
+    text(R"(},"weight":{"value":)"), number<2>(),
+    text(R"(}}],"shipper":{"address":{"countryCode":)"), string<0>(),
+    text(R"(}}},"version":{"major":1,"minor":0,"serviceId":"rate"}})"));
+
+// Argomenti: accessKey, userId, password, originCountry, destinationCountry,
+// weight, length, width, height
+constexpr auto ups = bodyTemplate(
+    text(R"({"AccessRequest":{"AccessLicenseNumber":)"), string<0>(),
+    text(R"(,"Password":)"), string<2>(),
+    text(R"(,"UserId":)"), string<1>(),
+    text(R"(},"RateRequest":{"Shipment":{"Package":[{"Dimensions":{"Height":)"), number<8>(),
+    text(R"(,"Length":)"), number<6>(),
+    text(R"(,"Width":)"), number<7>(),
+    text(R"(},"PackageWeight":{"UnitOfMeasurement":{"Code":"LBS"},"Weight":)"), number<5>(),
+    text(R"(},"PackagingType":{"Code":"02"}}],"ShipTo":{"Address":{"CountryCode":)"), string<4>(),
+    text(R"(}},"Shipper":{"Address":{"CountryCode":)"), string<3>(),
+    text(R"(}}}}})"));
+
+}  // namespace quotebodies
+
+inline void writeDhlQuoteBody(
+    std::string& out,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+    quotebodies::dhl.render(out, originCountry, destinationCountry, weight, length, width, height);
+}
+
+inline void writeFedExQuoteBody(
+    std::string& out,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+    quotebodies::fedex.render(out, originCountry, destinationCountry, weight, length, width, height);
+}
+
+inline void writeUpsQuoteBody(
+    std::string& out,
+    std::string_view accessKey,
+    std::string_view userId,
+    std::string_view password,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+    quotebodies::ups.render(out, accessKey, userId, password, originCountry, destinationCountry,
+                            weight, length, width, height);
+}
+
+// Colli di una richiesta a più colli (micro-batching, vedi quoteBatcher.hpp)
+struct QuotePackage {
+    double weight, length, width, height;
+};
+
+// Stessa forma del corpo FedEx a un collo, con un elemento di
+// requestedPackageLineItems per ogni collo
+inline void writeFedExBatchQuoteBody(
+    std::string& out,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    const std::vector<QuotePackage>& packages) {
+
+    JsonWriter json(out);
+    json.beginObject()
+        .key("requestedShipment").beginObject()
+            .field("packageCount", static_cast<int64_t>(packages.size()))
+            .key("recipient").beginObject().key("address").beginObject().field("countryCode", destinationCountry).endObject().endObject()
+            .key("requestedPackageLineItems").beginArray();
+    for (const auto& package : packages) {
+        json.beginObject()
+            .key("dimensions").beginObject()
+                .field("height", package.height).field("length", package.length).field("width", package.width)
+            .endObject()
+            .key("weight").beginObject().field("value", package.weight).endObject()
+            .endObject();
+    }
+    json.endArray()
+            .key("shipper").beginObject().key("address").beginObject().field("countryCode", originCountry).endObject().endObject()
+        .endObject()
+        .key("version").beginObject().field("major", 1).field("minor", 0).field("serviceId", "rate").endObject()
+        .endObject();
+}
+
+// Stessa forma del corpo UPS a un collo, con un elemento di Package per ogni collo
+inline void writeUpsBatchQuoteBody(
+    std::string& out,
+    std::string_view accessKey,
+    std::string_view userId,
+    std::string_view password,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    const std::vector<QuotePackage>& packages) {
+
+    JsonWriter json(out);
+    json.beginObject()
+        .key("AccessRequest").beginObject()
+            .field("AccessLicenseNumber", accessKey).field("Password", password).field("UserId", userId)
+        .endObject()
+        .key("RateRequest").beginObject().key("Shipment").beginObject()
+            .key("Package").beginArray();
+    for (const auto& package : packages) {
+        json.beginObject()
+            .key("Dimensions").beginObject()
+                .field("Height", package.height).field("Length", package.length).field("Width", package.width)
+            .endObject()
+            .key("PackageWeight").beginObject()
+                .key("UnitOfMeasurement").beginObject().field("Code", "LBS").endObject()
+                .field("Weight", package.weight)
+            .endObject()
+            .key("PackagingType").beginObject().field("Code", "02").endObject()
+            .endObject();
+    }
+    json.endArray()
+            .key("ShipTo").beginObject().key("Address").beginObject().field("CountryCode", destinationCountry).endObject().endObject()
+            .key("Shipper").beginObject().key("Address").beginObject().field("CountryCode", originCountry).endObject().endObject()
+        .endObject().endObject()
+        .endObject();
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "../common/config.hpp"
+#include "../common/metrics.hpp"
+
+// Scaglioni di fatturazione del vettore: peso e dimensioni vengono
+// arrotondati per eccesso allo scaglione prima di costruire la chiave
+struct BillingBrackets {
+    double weightStep;
+    double dimensionStep;
+};
+
+inline BillingBrackets billingBrackets(std::string_view carrier) {
+    if (carrier == "dhl") {
+        return {0.5, 1.0};   // kg a mezzo chilo, cm interi
+    }
+    return {1.0, 1.0};       // UPS/FedEx: libbre e pollici interi
+}
+
+inline double quantizeUp(double value, double step) {
+    // La tolleranza evita che 2.0000000001 salti allo scaglione successivo
+    return std::ceil(value / step - 1e-9) * step;
+}
+
+// Chiave della cache: a parità di account, tratta e scaglione la tariffa è la stessa.
+// Le credenziali entrano nella chiave come hash, così account con tariffe
+// negoziate diverse non condividono le voci
+inline std::string makeQuoteKey(
+    std::string_view carrier,
+    std::string_view account,
+    std::string_view originCountry,
+    std::string_view destinationCountry,
+    double weight, double length, double width, double height) {
+
+    BillingBrackets brackets = billingBrackets(carrier);
+    char dimensions[128];
+    std::snprintf(dimensions, sizeof(dimensions), "%.2f|%.2f|%.2f|%.2f",
+                  quantizeUp(weight, brackets.weightStep),
+                  quantizeUp(length, brackets.dimensionStep),
+                  quantizeUp(width, brackets.dimensionStep),
+                  quantizeUp(height, brackets.dimensionStep));
+
+    char accountHash[24];
+    std::snprintf(accountHash, sizeof(accountHash), "%zu", std::hash<std::string_view>{}(account));
+
+    std::string key;
+    key.reserve(carrier.size() + originCountry.size() + destinationCountry.size() + sizeof(accountHash) + sizeof(dimensions));
+    key.append(carrier).append("|").append(accountHash).append("|")
+       .append(originCountry).append("|").append(destinationCountry).append("|").append(dimensions);
+    return key;
+}
+
+// Sezione "quote_cache" della configurazione: la voce "default" vale per
+// tutti i vettori, la voce con il nome del vettore la sovrascrive
+struct QuoteCacheSettings {
+    size_t maxEntries = 100000;
+    std::chrono::seconds ttl = std::chrono::minutes(5);
+    size_t shards = 16;
+};
+
+inline QuoteCacheSettings quoteCacheSettings(const std::string& carrier) {
+    QuoteCacheSettings settings;
+    const auto& sections = config().value("quote_cache", nlohmann::json::object());
+
+    for (const char* key : {"default", carrier.c_str()}) {
+        auto it = sections.find(key);
+        if (it == sections.end()) {
+            continue;
+        }
+        settings.maxEntries = it->value("max_entries", settings.maxEntries);
+        settings.ttl = std::chrono::seconds(it->value("ttl_seconds", static_cast<int64_t>(settings.ttl.count())));
+        settings.shards = it->value("shards", settings.shards);
+    }
+
+    settings.shards = std::max<size_t>(1, settings.shards);
+    settings.maxEntries = std::max(settings.shards, settings.maxEntries);
+    return settings;
+}
+
+// Contatori della cache dei preventivi, leggibili anche da altri thread
+struct QuoteCacheStats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> coalesced{0};   // richieste unite a una chiamata upstream già in corso
+    std::atomic<uint64_t> evictions{0};
+};
+
+// Cache LRU con TTL dei preventivi di spedizione, divisa in shard con lock
+// indipendenti. Le richieste identiche in volo vengono unite in una sola
+// chiamata upstream; i hit sono serviti subito, senza passare da libcurl.
+// Lo status HTTP arriva fino alle richieste in attesa, che possono così
+// riprovare gli errori transitori; solo le risposte 200 finiscono in cache.
+class QuoteCache {
+public:
+    // I hit hanno status 200
+    using ResultCallback = std::function<void(long status, const std::string& response)>;
+    using DoneCallback = std::function<void(long status, std::string response)>;
+    using Fetcher = std::function<void(DoneCallback done)>;
+
+    explicit QuoteCache(const QuoteCacheSettings& settings)
+        : shards_(settings.shards), maxEntriesPerShard_(std::max<size_t>(1, settings.maxEntries / settings.shards)),
+          ttl_(settings.ttl) {
+        auto probe = [this](const char* result, const std::atomic<uint64_t>& value) {
+            probes_.push_back(metrics().probe("ow_quote_cache_requests_total", "Richieste alla cache dei preventivi per esito",
+                "counter", std::string("result=\"") + result + "\"", [&value] { return static_cast<double>(value.load()); }));
+        };
+        probe("hit", stats_.hits);
+        probe("miss", stats_.misses);
+        probe("coalesced", stats_.coalesced);
+        probes_.push_back(metrics().probe("ow_quote_cache_evictions_total", "Voci scartate dalla cache dei preventivi",
+            "counter", "", [this] { return static_cast<double>(stats_.evictions.load()); }));
+    }
+
+    void getOrFetch(const std::string& key, const Fetcher& fetcher, ResultCallback onResult) {
+        Shard& shard = shardFor(key);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            if (Clock::now() < it->second.expiresAt) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lruPosition);
+                std::string response = it->second.response;
+                lock.unlock();
+                stats_.hits++;
+                onResult(200, response);
+                return;
+            }
+            shard.lru.erase(it->second.lruPosition);
+            shard.entries.erase(it);
+        }
+
+        auto pending = shard.inFlight.find(key);
+        if (pending != shard.inFlight.end()) {
+            pending->second.push_back(std::move(onResult));
+            lock.unlock();
+            stats_.coalesced++;
+            return;
+        }
+
+        shard.inFlight[key].push_back(std::move(onResult));
+        lock.unlock();
+        stats_.misses++;
+
+        fetcher([this, key](long status, std::string response) {
+            complete(key, status, std::move(response));
+        });
+    }
+
+    const QuoteCacheStats& stats() const { return stats_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string response;
+        Clock::time_point expiresAt;
+        std::list<std::string>::iterator lruPosition;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru;
+        std::unordered_map<std::string, std::vector<ResultCallback>> inFlight;
+    };
+
+    Shard& shardFor(const std::string& key) {
+        return shards_[std::hash<std::string>{}(key) % shards_.size()];
+    }
+
+    void complete(const std::string& key, long status, std::string response) {
+        Shard& shard = shardFor(key);
+        std::vector<ResultCallback> waiters;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto pending = shard.inFlight.find(key);
+            if (pending != shard.inFlight.end()) {
+                waiters.swap(pending->second);
+                shard.inFlight.erase(pending);
+            }
+
+            if (status == 200) {
+                auto existing = shard.entries.find(key);
+                if (existing != shard.entries.end()) {
+                    shard.lru.erase(existing->second.lruPosition);
+                    shard.entries.erase(existing);
+                }
+                while (shard.entries.size() >= maxEntriesPerShard_ && !shard.lru.empty()) {
+                    shard.entries.erase(shard.lru.back());
+                    shard.lru.pop_back();
+                    stats_.evictions++;
+                }
+                shard.lru.push_front(key);
+                shard.entries[key] = Entry{response, Clock::now() + ttl_, shard.lru.begin()};
+            }
+        }
+
+        for (auto& waiter : waiters) {
+            waiter(status, response);
+        }
+    }
+
+    std::vector<Shard> shards_;
+    size_t maxEntriesPerShard_;
+    std::chrono::seconds ttl_;
+    QuoteCacheStats stats_;
+    std::vector<ProbeHandle> probes_;
+};
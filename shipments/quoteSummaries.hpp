@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include "../common/jsonStream.hpp"
+#include "../common/responseSummary.hpp"
+#include "rateShopping.hpp"
+
+// Campi dei preventivi estratti dalle risposte dei vettori mentre arrivano
+// (stessi campi di parseDhlRates, parseFedExRates e parseUpsRates).
+// I prezzi possono essere numeri o stringhe
+
+// DHL: products[i].productName, totalPrice[0].price e priceCurrency,
+// deliveryCapabilities.totalTransitDays
+inline void extractDhlQuote(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary) {
+    if (!parser.startsWith({"products", "[]"})) {
+        return;
+    }
+    SummaryOption& option = summary.option(parser.index(1));
+    double number = 0;
+    if (token == JsonToken::String && parser.matches({"productName"}, 2)) {
+        option.service.assign(value);
+    } else if (parser.startsWith({"totalPrice", "[]"}, 2) && parser.index(3) == 0) {
+        if (parser.matches({"price"}, 4) && summaryNumber(token, value, number)) {
+            option.price = number;
+            option.hasPrice = true;
+        } else if (token == JsonToken::String && parser.matches({"priceCurrency"}, 4)) {
+            option.currency.assign(value);
+        }
+    } else if (parser.matches({"deliveryCapabilities", "totalTransitDays"}, 2) && summaryNumber(token, value, number)) {
+        option.transitDays = static_cast<int>(number);
+    }
+}
+
+// FedEx: output.rateReplyDetails[i].serviceType, ratedShipmentDetails[0].totalNetCharge
+// e currency, commit.transitDays.minimumTransitTime ("TWO_DAYS")
+inline void extractFedExQuote(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary) {
+    if (!parser.startsWith({"output", "rateReplyDetails", "[]"})) {
+        return;
+    }
+    SummaryOption& option = summary.option(parser.index(2));
+    double number = 0;
+    if (token == JsonToken::String && parser.matches({"serviceType"}, 3)) {
+        option.service.assign(value);
+    } else if (parser.startsWith({"ratedShipmentDetails", "[]"}, 3) && parser.index(4) == 0) {
+        if (parser.matches({"totalNetCharge"}, 5) && summaryNumber(token, value, number)) {
+            option.price = number;
+            option.hasPrice = true;
+        } else if (token == JsonToken::String && parser.matches({"currency"}, 5)) {
+            option.currency.assign(value);
+        }
+    } else if (token == JsonToken::String && parser.matches({"commit", "transitDays", "minimumTransitTime"}, 3)) {
+        option.transitDays = fedexTransitDays(std::string(value));
+    }
+}
+
+// UPS: RateResponse.RatedShipment (un oggetto se il servizio è uno solo, un
+// array altrimenti) con Service.Code, TotalCharges.MonetaryValue e CurrencyCode,
+// GuaranteedDelivery.BusinessDaysInTransit
+inline void extractUpsQuote(const JsonPushParser& parser, JsonToken token, std::string_view value, ResponseSummary& summary) {
+    if (!parser.startsWith({"RateResponse", "RatedShipment"})) {
+        return;
+    }
+    bool array = parser.startsWith({"[]"}, 2);
+    size_t base = array ? 3 : 2;
+    if (parser.depth() <= base) {
+        return;
+    }
+    SummaryOption& option = summary.option(array ? parser.index(2) : 0);
+    double number = 0;
+    if (token == JsonToken::String && parser.matches({"Service", "Code"}, base)) {
+        option.service.assign(value);
+    } else if (parser.matches({"TotalCharges", "MonetaryValue"}, base) && summaryNumber(token, value, number)) {
+        option.price = number;
+        option.hasPrice = true;
+    } else if (token == JsonToken::String && parser.matches({"TotalCharges", "CurrencyCode"}, base)) {
+        option.currency.assign(value);
+    } else if (parser.matches({"GuaranteedDelivery", "BusinessDaysInTransit"}, base) && summaryNumber(token, value, number)) {
+        option.transitDays = static_cast<int>(number);
+    }
+}
+
+inline const ResponseSchema& dhlQuoteSchema() {
+    static const ResponseSchema schema{"dhl", &extractDhlQuote, &renderQuoteSummary};
+    return schema;
+}
+
+inline const ResponseSchema& fedexQuoteSchema() {
+    static const ResponseSchema schema{"fedex", &extractFedExQuote, &renderQuoteSummary};
+    return schema;
+}
+
+inline const ResponseSchema& upsQuoteSchema() {
+    static const ResponseSchema schema{"ups", &extractUpsQuote, &renderQuoteSummary};
+    return schema;
+}
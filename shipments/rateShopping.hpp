@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "../common/config.hpp"
+#include "../common/messageArena.hpp"
+#include "../common/metrics.hpp"
+
+// Confronto tariffe tra vettori ("best rate"): la stessa spedizione viene
+// quotata in parallelo da UPS, FedEx e DHL e vince l'opzione più economica
+// o quella con meno giorni di transito.
+
+enum class RateCriterion { Price, Transit };
+
+// Un servizio quotato da un vettore
+struct RateOption {
+    std::string service;
+    double price = 0;
+    std::string currency;
+    double comparablePrice = 0;   // prezzo nella valuta di riferimento
+    int transitDays = -1;         // -1 se il vettore non lo indica
+};
+
+// Esito della richiesta a un vettore
+struct CarrierQuote {
+    std::string carrier;
+    bool ok = false;
+    std::string error;            // motivo se !ok
+    std::vector<RateOption> options;
+    uint64_t latencyUs = 0;
+};
+
+// Sezione "rate_shopping" della configurazione. Le tariffe dei vettori possono
+// essere in valute diverse: exchange_rates dà il valore di un'unità di ogni
+// valuta in base_currency (le valute assenti valgono 1)
+struct RateShoppingSettings {
+    std::chrono::milliseconds deadline{3000};
+    RateCriterion criterion = RateCriterion::Price;
+    std::string baseCurrency = "EUR";
+    std::unordered_map<std::string, double> exchangeRates;
+};
+
+inline RateCriterion parseRateCriterion(const std::string& name, RateCriterion fallback) {
+    if (name == "price") return RateCriterion::Price;
+    if (name == "transit") return RateCriterion::Transit;
+    return fallback;
+}
+
+inline const RateShoppingSettings& rateShoppingSettings() {
+    static const RateShoppingSettings settings = [] {
+        RateShoppingSettings loaded;
+        const auto& section = config().value("rate_shopping", nlohmann::json::object());
+        loaded.deadline = std::chrono::milliseconds(section.value("deadline_ms", 3000));
+        loaded.criterion = parseRateCriterion(section.value("criterion", std::string("price")), loaded.criterion);
+        loaded.baseCurrency = section.value("base_currency", loaded.baseCurrency);
+        // La copia restituita da value() deve vivere quanto il ciclo su items()
+        nlohmann::json exchangeRates = section.value("exchange_rates", nlohmann::json::object());
+        for (const auto& [currency, rate] : exchangeRates.items()) {
+            loaded.exchangeRates[currency] = rate.get<double>();
+        }
+        return loaded;
+    }();
+    return settings;
+}
+
+inline double toBaseCurrency(double price, const std::string& currency) {
+    const auto& rates = rateShoppingSettings().exchangeRates;
+    auto it = rates.find(currency);
+    return it == rates.end() ? price : price * it->second;
+}
+
+// Numero che alcuni vettori restituiscono come stringa (es. UPS "38.90")
+template <typename Json>
+double jsonNumber(const Json& value) {
+    if (value.is_string()) {
+        return std::stod(value.template get<std::string>());
+    }
+    return value.template get<double>();
+}
+
+// Giorni di transito FedEx: "ONE_DAY", "TWO_DAYS", ...
+inline int fedexTransitDays(const std::string& value) {
+    static const char* words[] = {"ONE", "TWO", "THREE", "FOUR", "FIVE", "SIX", "SEVEN",
+                                  "EIGHT", "NINE", "TEN", "ELEVEN", "TWELVE", "THIRTEEN", "FOURTEEN"};
+    for (int i = 0; i < 14; i++) {
+        std::string word = words[i];
+        if (value.compare(0, word.size() + 1, word + "_") == 0) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+template <typename Json>
+std::vector<RateOption> parseDhlRates(const Json& response) {
+    std::vector<RateOption> options;
+    for (const auto& product : response.at("products")) {
+        const auto& price = product.at("totalPrice").at(0);
+        RateOption option;
+        option.service = product.value("productName", std::string());
+        option.price = jsonNumber(price.at("price"));
+        option.currency = price.value("priceCurrency", std::string());
+        if (product.contains("deliveryCapabilities")) {
+            option.transitDays = product["deliveryCapabilities"].value("totalTransitDays", -1);
+        }
+        options.push_back(std::move(option));
+    }
+    return options;
+}
+
+template <typename Json>
+std::vector<RateOption> parseFedExRates(const Json& response) {
+    std::vector<RateOption> options;
+    for (const auto& detail : response.at("output").at("rateReplyDetails")) {
+        const auto& rated = detail.at("ratedShipmentDetails").at(0);
+        RateOption option;
+        option.service = detail.value("serviceType", std::string());
+        option.price = jsonNumber(rated.at("totalNetCharge"));
+        option.currency = rated.value("currency", std::string());
+        if (detail.contains("commit") && detail["commit"].contains("transitDays")) {
+            option.transitDays = fedexTransitDays(detail["commit"]["transitDays"].value("minimumTransitTime", std::string()));
+        }
+        options.push_back(std::move(option));
+    }
+    return options;
+}
+
+template <typename Json>
+std::vector<RateOption> parseUpsRates(const Json& response) {
+    std::vector<RateOption> options;
+    const auto& rated = response.at("RateResponse").at("RatedShipment");
+    // UPS restituisce un oggetto se il servizio è uno solo, un array altrimenti
+    auto parse = [&options](const Json& shipment) {
+        const auto& charges = shipment.at("TotalCharges");
+        RateOption option;
+        if (shipment.contains("Service")) {
+            option.service = shipment["Service"].value("Code", std::string());
+        }
+        option.price = jsonNumber(charges.at("MonetaryValue"));
+        option.currency = charges.value("CurrencyCode", std::string());
+        if (shipment.contains("GuaranteedDelivery") && shipment["GuaranteedDelivery"].contains("BusinessDaysInTransit")) {
+            option.transitDays = static_cast<int>(jsonNumber(shipment["GuaranteedDelivery"]["BusinessDaysInTransit"]));
+        }
+        options.push_back(std::move(option));
+    };
+    if (rated.is_array()) {
+        for (const auto& shipment : rated) {
+            parse(shipment);
+        }
+    } else {
+        parse(rated);
+    }
+    return options;
+}
+
+// Esito di una risposta HTTP del vettore (status 0: richiesta non partita).
+// Il DOM della risposta è nell'arena dello scope corrente, se c'è
+inline CarrierQuote parseCarrierQuote(const std::string& carrier, long status, const std::string& body) {
+    CarrierQuote quote;
+    quote.carrier = carrier;
+    if (status != 200) {
+        quote.error = status == 0 ? "Errore nella richiesta HTTP" : "Status HTTP " + std::to_string(status);
+        return quote;
+    }
+    try {
+        auto response = ArenaJson::parse(body);
+        if (carrier == "dhl") quote.options = parseDhlRates(response);
+        else if (carrier == "fedex") quote.options = parseFedExRates(response);
+        else if (carrier == "ups") quote.options = parseUpsRates(response);
+    } catch (const std::exception& e) {
+        quote.error = std::string("Risposta non valida: ") + e.what();
+        return quote;
+    }
+    for (auto& option : quote.options) {
+        option.comparablePrice = toBaseCurrency(option.price, option.currency);
+    }
+    quote.ok = !quote.options.empty();
+    if (!quote.ok) {
+        quote.error = "Nessuna tariffa nella risposta";
+    }
+    return quote;
+}
+
+// Ordine delle opzioni secondo il criterio; a parità decide l'altro criterio.
+// Il transito sconosciuto viene dopo qualsiasi transito noto
+inline bool betterRate(const RateOption& a, const RateOption& b, RateCriterion criterion) {
+    auto transit = [](const RateOption& option) {
+        return option.transitDays < 0 ? std::numeric_limits<int>::max() : option.transitDays;
+    };
+    if (criterion == RateCriterion::Transit && transit(a) != transit(b)) {
+        return transit(a) < transit(b);
+    }
+    if (a.comparablePrice != b.comparablePrice) {
+        return a.comparablePrice < b.comparablePrice;
+    }
+    return transit(a) < transit(b);
+}
+
+// Risposta del confronto: l'opzione migliore e il riepilogo di ogni vettore
+// (costruita nell'arena dello scope corrente, se c'è)
+inline std::string bestRateReply(const std::vector<CarrierQuote>& quotes, RateCriterion criterion) {
+    const CarrierQuote* bestQuote = nullptr;
+    const RateOption* best = nullptr;
+    ArenaJson summary = ArenaJson::array();
+    for (const auto& quote : quotes) {
+        ArenaJson entry = {{"carrier", quote.carrier}, {"latency_ms", quote.latencyUs / 1000.0}};
+        if (!quote.ok) {
+            entry["status"] = "error";
+            entry["message"] = quote.error;
+            summary.push_back(entry);
+            continue;
+        }
+        const RateOption* carrierBest = &quote.options.front();
+        for (const auto& option : quote.options) {
+            if (betterRate(option, *carrierBest, criterion)) {
+                carrierBest = &option;
+            }
+        }
+        entry["status"] = "ok";
+        entry["service"] = carrierBest->service;
+        entry["price"] = carrierBest->price;
+        entry["currency"] = carrierBest->currency;
+        summary.push_back(entry);
+        if (!best || betterRate(*carrierBest, *best, criterion)) {
+            best = carrierBest;
+            bestQuote = &quote;
+        }
+    }
+
+    ArenaJson reply;
+    reply["criterion"] = criterion == RateCriterion::Price ? "price" : "transit";
+    reply["quotes"] = std::move(summary);
+    if (!best) {
+        reply["status"] = "error";
+        reply["message"] = "Nessun preventivo valido entro la scadenza";
+        return dumpJson(reply);
+    }
+    reply["status"] = "ok";
+    reply["carrier"] = bestQuote->carrier;
+    reply["service"] = best->service;
+    reply["price"] = best->price;
+    reply["currency"] = best->currency;
+    if (best->transitDays >= 0) {
+        reply["transit_days"] = best->transitDays;
+    }
+    return dumpJson(reply);
+}
+
+// Esiti delle richieste ai vettori: ok, error, timeout (annullate alla scadenza)
+// o unavailable (non inviate per circuito aperto o limite di richieste)
+inline Counter& rateShoppingCounter(const std::string& carrier, const std::string& result) {
+    return metrics().counter("ow_rate_shopping_quotes_total", "Preventivi richiesti nel confronto tariffe per vettore ed esito",
+                             "carrier=\"" + carrier + "\",result=\"" + result + "\"");
+}